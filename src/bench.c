@@ -0,0 +1,495 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * ledcap-bench - benchmark all registered capture mechanisms
+ *
+ * Captures a sweep of frame sizes with every mechanism (or only the one
+ * given on the commandline) from $DISPLAY and prints one CSV line per
+ * mechanism & size. "make bench" runs it against a private Xvfb.
+ *
+ * CPU time is the time spent by this process only, work done by the
+ * X server isn't accounted for.
+ *
+ * Mechanisms that read from a producer or need options to find their
+ * source (see _external) are only benchmarked when selected with -m
+ * (options are passed with -o like ledcap does).
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <niftyled.h>
+#include "capture.h"
+
+
+/** maximum amount of sizes to sweep */
+#define BENCH_SIZES_MAX 16
+/** frames captured before measuring starts */
+#define BENCH_WARMUP 5
+/** maximum amount of --option arguments */
+#define OPTIONS_MAX 16
+
+/** nanoseconds per second */
+#define NSEC 1000000000LL
+
+
+/** one size of the sweep */
+typedef struct
+{
+        LedFrameCord w;
+        LedFrameCord h;
+} BenchSize;
+
+
+/** private structure to hold info accros function-calls */
+static struct
+{
+        /** only benchmark this mechanism (METHOD_MIN = all) */
+        CaptureMethod method;
+        /** amount of frames to capture per run */
+        int frames;
+        /** sizes to capture */
+        BenchSize sizes[BENCH_SIZES_MAX];
+        /** amount of sizes */
+        int n;
+        /** options for selected capture mechanism */
+        struct
+        {
+                const char *key;
+                const char *value;
+        } options[OPTIONS_MAX];
+        /** amount of options */
+        int n_options;
+} _c;
+
+
+
+/** mechanisms that need input or options, never run unless selected */
+static const char *_external[] = {
+        "mmap",
+        "pipe",
+        "shm",
+        "XComposite",
+};
+
+
+
+/** true if mechanism needs input or options we can't provide */
+static bool _is_external(CaptureMethod m)
+{
+        size_t i;
+        for(i = 0; i < sizeof(_external) / sizeof(_external[0]); i++)
+        {
+                if(strcmp(capture_method_to_string(m), _external[i]) == 0)
+                        return true;
+        }
+
+        return false;
+}
+
+
+/** current time on CLOCK_MONOTONIC in nanoseconds */
+static long long _now()
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * NSEC + ts.tv_nsec;
+}
+
+
+/** user + system time of this process in nanoseconds */
+static long long _cpu()
+{
+        struct rusage r;
+        if(getrusage(RUSAGE_SELF, &r) != 0)
+                return 0;
+
+        return (r.ru_utime.tv_sec + r.ru_stime.tv_sec) * NSEC +
+                (r.ru_utime.tv_usec + r.ru_stime.tv_usec) * 1000LL;
+}
+
+
+/** compare two long longs for qsort() */
+static int _cmp(const void *a, const void *b)
+{
+        long long x = *(const long long *) a, y = *(const long long *) b;
+        return (x > y) - (x < y);
+}
+
+
+/** parse list of sizes like "64x64,640x480" */
+static NftResult _parse_sizes(const char *list)
+{
+        _c.n = 0;
+
+        const char *s;
+        for(s = list; s && *s; s = strchr(s, ','), s = s ? s + 1 : NULL)
+        {
+                if(_c.n >= BENCH_SIZES_MAX)
+                {
+                        NFT_LOG(L_ERROR, "Too many sizes (max. %d)",
+                                BENCH_SIZES_MAX);
+                        return NFT_FAILURE;
+                }
+
+                int w, h;
+                if(sscanf(s, "%32dx%32d", &w, &h) != 2 || w <= 0 || h <= 0)
+                {
+                        NFT_LOG(L_ERROR,
+                                "Invalid size \"%s\" (Use <w>x<h>[,<w>x<h>...])",
+                                s);
+                        return NFT_FAILURE;
+                }
+
+                _c.sizes[_c.n].w = w;
+                _c.sizes[_c.n].h = h;
+                _c.n++;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/** print commandline help */
+static void _print_help(char *name)
+{
+        printf("Benchmark capture mechanisms of ledcap - %s\n"
+               "Usage: %s [options]\n\n"
+               "Valid options:\n"
+               "\t--help\t\t\t-h\t\tThis help text\n"
+               "\t--mechanism <name>\t-m <name>\tOnly benchmark this mechanism (default: all but mmap, pipe, shm & XComposite)\n"
+               "\t--option <k>=<v>\t-o <k>=<v>\tSet option of mechanism selected with -m (e.g. -o window=0x3a00007)\n"
+               "\t--sizes <list>\t\t-s <list>\tComma separated list of <w>x<h> (default: 64x64,640x480,1920x1080)\n"
+               "\t--frames <n>\t\t-n <n>\t\tFrames to capture per mechanism & size (default: 200)\n"
+               "\t--loglevel <level>\t-l <level>\tOnly show messages with loglevel <level> (default: warning)\n\n",
+               PACKAGE_URL, name);
+
+        capture_print_mechanisms();
+}
+
+
+/** parse commandline arguments */
+static NftResult _parse_args(int argc, char *argv[])
+{
+        int index, argument;
+
+        static struct option loptions[] = {
+                {"help", 0, 0, 'h'},
+                {"mechanism", required_argument, 0, 'm'},
+                {"option", required_argument, 0, 'o'},
+                {"sizes", required_argument, 0, 's'},
+                {"frames", required_argument, 0, 'n'},
+                {"loglevel", required_argument, 0, 'l'},
+                {0, 0, 0, 0}
+        };
+
+        while((argument =
+               getopt_long(argc, argv, "hm:o:s:n:l:", loptions, &index)) >= 0)
+        {
+                switch (argument)
+                {
+                        /* --help */
+                        case 'h':
+                        {
+                                _print_help(argv[0]);
+                                return NFT_FAILURE;
+                        }
+
+                        /* --mechanism */
+                        case 'm':
+                        {
+                                _c.method = capture_method_from_string(optarg);
+                                if(!METHOD_VALID(_c.method))
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Unknown capture mechanism \"%s\"",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+                                break;
+                        }
+
+                        /* --option */
+                        case 'o':
+                        {
+                                char *value;
+                                if(!(value = strchr(optarg, '=')))
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Invalid option \"%s\" (Use <key>=<value>)",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+
+                                if(_c.n_options >= OPTIONS_MAX)
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Too many options (max. %d)",
+                                                OPTIONS_MAX);
+                                        return NFT_FAILURE;
+                                }
+
+                                /* split argument into key & value */
+                                *value++ = '\0';
+                                _c.options[_c.n_options].key = optarg;
+                                _c.options[_c.n_options].value = value;
+                                _c.n_options++;
+                                break;
+                        }
+
+                        /* --sizes */
+                        case 's':
+                        {
+                                if(!_parse_sizes(optarg))
+                                        return NFT_FAILURE;
+                                break;
+                        }
+
+                        /* --frames */
+                        case 'n':
+                        {
+                                if(sscanf(optarg, "%32d", &_c.frames) != 1 ||
+                                   _c.frames <= 0)
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Invalid amount of frames \"%s\" (Use a positive integer)",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+                                break;
+                        }
+
+                        /* --loglevel */
+                        case 'l':
+                        {
+                                if(!nft_log_level_set
+                                   (nft_log_level_from_string(optarg)))
+                                {
+                                        printf("\nValid loglevels:\n\t");
+                                        nft_log_print_loglevels();
+                                        printf("\n\n");
+                                        return NFT_FAILURE;
+                                }
+                                break;
+                        }
+
+                        /* invalid argument */
+                        case '?':
+                        {
+                                NFT_LOG(L_ERROR, "argument %d is invalid",
+                                        index);
+                                _print_help(argv[0]);
+                                return NFT_FAILURE;
+                        }
+
+                        /* unhandled arguments */
+                        default:
+                        {
+                                NFT_LOG(L_ERROR, "argument %d is invalid",
+                                        index);
+                                break;
+                        }
+                }
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/** capture frames of one size with the current mechanism & print results */
+static NftResult _run(CaptureMethod m, BenchSize * size, long long *lat)
+{
+        NftResult res = NFT_FAILURE;
+
+        LedFrame *frame;
+        if(!(frame = led_frame_new(size->w, size->h,
+                                   led_pixel_format_from_string
+                                   (capture_format()))))
+                return NFT_FAILURE;
+
+        led_frame_set_big_endian(frame, capture_is_big_endian());
+
+        /* let mechanism allocate its buffers */
+        int i;
+        for(i = 0; i < BENCH_WARMUP; i++)
+        {
+                if(!capture_frame(frame, 0, 0))
+                        goto _r_exit;
+        }
+
+        long long cpu = _cpu();
+        long long start = _now();
+        for(i = 0; i < _c.frames; i++)
+        {
+                long long t = _now();
+                if(!capture_frame(frame, 0, 0))
+                        goto _r_exit;
+                lat[i] = _now() - t;
+        }
+        long long elapsed = _now() - start;
+        cpu = _cpu() - cpu;
+
+        qsort(lat, _c.frames, sizeof(long long), _cmp);
+
+        size_t bytes = led_frame_get_buffersize(frame);
+        printf("%s,%d,%d,%d,%.2f,%.3f,%.3f,%.3f,%.3f,%.3f,%zu,%.2f\n",
+               capture_method_to_string(m), size->w, size->h, _c.frames,
+               (double) _c.frames * NSEC / elapsed,
+               lat[_c.frames / 2] / 1e6,
+               lat[(_c.frames * 90) / 100] / 1e6,
+               lat[(_c.frames * 99) / 100] / 1e6,
+               lat[_c.frames - 1] / 1e6,
+               (double) cpu / _c.frames / 1e6, bytes,
+               (double) bytes * _c.frames / elapsed * NSEC / (1024 * 1024));
+        fflush(stdout);
+
+        res = NFT_SUCCESS;
+
+_r_exit:
+        led_frame_destroy(frame);
+        return res;
+}
+
+
+int main(int argc, char *argv[])
+{
+        int res = EXIT_FAILURE;
+        long long *lat = NULL;
+
+        /* check binary version compatibility */
+        if(!LED_CHECK_VERSION)
+                return EXIT_FAILURE;
+
+        /* only complain about problems, stdout is for results */
+        if(!nft_log_level_set(L_WARNING))
+        {
+                fprintf(stderr, "nft_log_level_set() error");
+                goto _m_exit;
+        }
+
+        /* defaults */
+        _c.method = METHOD_MIN;
+        _c.frames = 200;
+        if(!_parse_sizes("64x64,640x480,1920x1080"))
+                goto _m_exit;
+
+        /* parse cmdline-arguments */
+        if(!_parse_args(argc, argv))
+                goto _m_exit;
+
+        /* options are specific to one mechanism */
+        if(_c.n_options && _c.method == METHOD_MIN)
+        {
+                NFT_LOG(L_ERROR, "Select mechanism with -m to pass options");
+                goto _m_exit;
+        }
+
+        int o;
+        for(o = 0; o < _c.n_options; o++)
+        {
+                if(!capture_option(_c.method, _c.options[o].key,
+                                   _c.options[o].value))
+                        goto _m_exit;
+        }
+
+        if(!(lat = calloc(_c.frames, sizeof(long long))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                goto _m_exit;
+        }
+
+        printf("mechanism,width,height,frames,fps,p50_ms,p90_ms,p99_ms,"
+               "max_ms,cpu_ms_per_frame,bytes_per_frame,mb_per_s\n");
+
+        /* assume success, failing runs are reported but don't stop us */
+        res = EXIT_SUCCESS;
+
+        CaptureMethod m;
+        for(m = METHOD_MIN + 1; m < METHOD_MAX; m++)
+        {
+                if(_c.method != METHOD_MIN && m != _c.method)
+                        continue;
+
+                /* would wait for input or fail without options */
+                if(_c.method == METHOD_MIN && _is_external(m))
+                {
+                        NFT_LOG(L_INFO,
+                                "Skipping \"%s\" (select it with -m & set its source with -o)",
+                                capture_method_to_string(m));
+                        continue;
+                }
+
+                if(!capture_init(m))
+                {
+                        res = EXIT_FAILURE;
+                        continue;
+                }
+
+                int s;
+                for(s = 0; s < _c.n; s++)
+                {
+                        if(!_run(m, &_c.sizes[s], lat))
+                        {
+                                NFT_LOG(L_WARNING,
+                                        "Benchmark of \"%s\" at %dx%d failed",
+                                        capture_method_to_string(m),
+                                        _c.sizes[s].w, _c.sizes[s].h);
+                                res = EXIT_FAILURE;
+                        }
+                }
+
+                capture_deinit();
+        }
+
+_m_exit:
+        free(lat);
+
+        return res;
+}
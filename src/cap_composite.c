@@ -0,0 +1,645 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * capture mechanism that captures one window (even when it's occluded) by
+ * redirecting it with XComposite & reading its backing pixmap
+ *
+ * x/y of the capture rectangle are relative to the window. Parts of the
+ * frame outside of the window are black.
+ *
+ * options (one of window, name or class is needed):
+ *      window  id of window (e.g. 0x3a00007)
+ *      name    capture first window whose title contains this
+ *      class   capture first window with this WM_CLASS (name or class)
+ */
+
+#include "config.h"
+
+#if defined(HAVE_X) && defined(HAVE_XCOMPOSITE)
+
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xatom.h>
+#include <X11/extensions/Xcomposite.h>
+#ifdef HAVE_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif /* HAVE_XSHM */
+#include <niftyled.h>
+#include "capture.h"
+#include "cap_composite.h"
+
+
+/** private structure to hold info accros function-calls */
+static struct
+{
+        Display *display;
+        int screen;
+        /** last X error code (set by _err_handler) */
+        int error;
+        /** id of window from options (0 = search by name/class) */
+        Window id;
+        /** title to search for */
+        char name[256];
+        /** WM_CLASS to search for */
+        char class[256];
+        /** captured window */
+        Window window;
+        /** current size of window */
+        int ww, wh;
+        /** true if window is mapped (it has no pixmap otherwise) */
+        bool mapped;
+        /** backing pixmap of window (None = needs to be named) */
+        Pixmap pixmap;
+#ifdef HAVE_XSHM
+        /** true if MIT-SHM is used */
+        bool shm;
+        /** persistent image living in shared memory */
+        XImage *image;
+        /** shared memory segment backing image */
+        XShmSegmentInfo shminfo;
+#endif /* HAVE_XSHM */
+} _c;
+
+
+
+
+/** X11 Error handler */
+static int _err_handler(Display * d, XErrorEvent * err)
+{
+        char msg[256];
+        XGetErrorText(d, err->error_code, msg, sizeof(msg));
+        NFT_LOG(L_DEBUG, "X error: %s", msg);
+        _c.error = err->error_code;
+        return 0;
+}
+
+
+/**
+ * set option
+ */
+static NftResult _option(const char *key, const char *value)
+{
+        if(strcmp(key, "window") == 0)
+        {
+                char *end;
+                _c.id = strtoul(value, &end, 0);
+                if(*end || !_c.id)
+                {
+                        NFT_LOG(L_ERROR, "Invalid window id: %s", value);
+                        return NFT_FAILURE;
+                }
+        }
+        else if(strcmp(key, "name") == 0 || strcmp(key, "class") == 0)
+        {
+                char *dst = key[0] == 'n' ? _c.name : _c.class;
+                if(strlen(value) >= sizeof(_c.name))
+                {
+                        NFT_LOG(L_ERROR, "Value \"%s\" too long", value);
+                        return NFT_FAILURE;
+                }
+                strcpy(dst, value);
+        }
+        else
+        {
+                NFT_LOG(L_ERROR, "Unknown option \"%s\"", key);
+                return NFT_FAILURE;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * check if title or class of window match what we search for
+ */
+static bool _matches(Window w)
+{
+        bool match = false;
+
+        if(_c.class[0])
+        {
+                XClassHint hint;
+                if(XGetClassHint(_c.display, w, &hint))
+                {
+                        match = (hint.res_name &&
+                                 strcmp(hint.res_name, _c.class) == 0) ||
+                                (hint.res_class &&
+                                 strcmp(hint.res_class, _c.class) == 0);
+                        XFree(hint.res_name);
+                        XFree(hint.res_class);
+                }
+        }
+
+        if(_c.name[0] && !match)
+        {
+                /* prefer UTF-8 title of EWMH over WM_NAME */
+                Atom type;
+                int format;
+                unsigned long n, left;
+                unsigned char *title = NULL;
+                Atom utf8 = XInternAtom(_c.display, "UTF8_STRING", False);
+                Atom wmname = XInternAtom(_c.display, "_NET_WM_NAME", False);
+
+                if(XGetWindowProperty(_c.display, w, wmname, 0, 1024, False,
+                                      utf8, &type, &format, &n, &left,
+                                      &title) == Success && title)
+                {
+                        match = strstr((char *) title, _c.name) != NULL;
+                        XFree(title);
+                }
+                else
+                {
+                        char *name;
+                        if(XFetchName(_c.display, w, &name) && name)
+                        {
+                                match = strstr(name, _c.name) != NULL;
+                                XFree(name);
+                        }
+                }
+        }
+
+        return match;
+}
+
+
+/**
+ * search window tree below parent for first matching window
+ */
+static Window _find(Window parent)
+{
+        Window root, up, *children = NULL;
+        unsigned int n;
+        if(!XQueryTree(_c.display, parent, &root, &up, &children, &n))
+                return None;
+
+        Window found = None;
+        unsigned int i;
+        /* topmost children first */
+        for(i = n; i > 0 && !found; i--)
+        {
+                if(_matches(children[i - 1]))
+                        found = children[i - 1];
+                else
+                        found = _find(children[i - 1]);
+        }
+
+        if(children)
+                XFree(children);
+
+        return found;
+}
+
+
+#ifdef HAVE_XSHM
+
+/**
+ * destroy shared-memory image (if any)
+ */
+static void _shm_image_destroy()
+{
+        if(!_c.image)
+                return;
+
+        XShmDetach(_c.display, &_c.shminfo);
+        XDestroyImage(_c.image);
+        shmdt(_c.shminfo.shmaddr);
+        _c.image = NULL;
+}
+
+
+/**
+ * create shared-memory image of w x h pixels with depth of window
+ */
+static NftResult _shm_image_create(LedFrameCord w, LedFrameCord h,
+                                   XWindowAttributes * a)
+{
+        if(!(_c.image = XShmCreateImage(_c.display, a->visual, a->depth,
+                                        ZPixmap, NULL, &_c.shminfo, w, h)))
+        {
+                NFT_LOG(L_ERROR, "XShmCreateImage() failed");
+                return NFT_FAILURE;
+        }
+
+        if((_c.shminfo.shmid = shmget(IPC_PRIVATE,
+                                      _c.image->bytes_per_line *
+                                      _c.image->height,
+                                      IPC_CREAT | 0600)) < 0)
+        {
+                NFT_LOG_PERROR("shmget()");
+                goto _sic_error;
+        }
+
+        if((_c.shminfo.shmaddr = shmat(_c.shminfo.shmid, NULL, 0)) ==
+           (void *) -1)
+        {
+                NFT_LOG_PERROR("shmat()");
+                shmctl(_c.shminfo.shmid, IPC_RMID, NULL);
+                goto _sic_error;
+        }
+        _c.image->data = _c.shminfo.shmaddr;
+        _c.shminfo.readOnly = False;
+
+        _c.error = 0;
+        XShmAttach(_c.display, &_c.shminfo);
+        XSync(_c.display, False);
+
+        /* segment is destroyed as soon as both sides detached */
+        shmctl(_c.shminfo.shmid, IPC_RMID, NULL);
+
+        if(_c.error)
+        {
+                NFT_LOG(L_ERROR,
+                        "XShmAttach() failed. (Not a local X server?)");
+                shmdt(_c.shminfo.shmaddr);
+                goto _sic_error;
+        }
+
+        return NFT_SUCCESS;
+
+_sic_error:
+        XDestroyImage(_c.image);
+        _c.image = NULL;
+        return NFT_FAILURE;
+}
+
+#endif /* HAVE_XSHM */
+
+
+/**
+ * free backing pixmap so it's named again on next capture
+ */
+static void _pixmap_release()
+{
+        if(_c.pixmap)
+                XFreePixmap(_c.display, _c.pixmap);
+        _c.pixmap = None;
+}
+
+
+/**
+ * handle events of window. Pixmap is only re-created when it changed
+ */
+static NftResult _events()
+{
+        while(XPending(_c.display))
+        {
+                XEvent e;
+                XNextEvent(_c.display, &e);
+
+                switch (e.type)
+                {
+                        case ConfigureNotify:
+                        {
+                                if(e.xconfigure.window != _c.window)
+                                        break;
+
+                                /* a moved window keeps its pixmap */
+                                if(e.xconfigure.width == _c.ww &&
+                                   e.xconfigure.height == _c.wh)
+                                        break;
+
+                                _c.ww = e.xconfigure.width;
+                                _c.wh = e.xconfigure.height;
+                                _pixmap_release();
+                                NFT_LOG(L_VERBOSE, "Window resized to %dx%d",
+                                        _c.ww, _c.wh);
+                                break;
+                        }
+
+                        case MapNotify:
+                        {
+                                _c.mapped = true;
+                                _pixmap_release();
+                                break;
+                        }
+
+                        case UnmapNotify:
+                        {
+                                _c.mapped = false;
+                                _pixmap_release();
+                                break;
+                        }
+
+                        case DestroyNotify:
+                        {
+                                if(e.xdestroywindow.window != _c.window)
+                                        break;
+
+                                /* named pixmap outlives the window */
+                                NFT_LOG(L_ERROR, "Captured window is gone");
+                                _pixmap_release();
+                                _c.window = None;
+                                return NFT_FAILURE;
+                        }
+                }
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * copy rows of image into frame, clear rest of frame
+ */
+static void _copy(LedFrame * frame, XImage * image, LedFrameCord cw,
+                  LedFrameCord ch)
+{
+        LedFrameCord w, h;
+        led_frame_get_dim(frame, &w, &h);
+
+        size_t stride = (size_t) w * 4;
+        char *dst = led_frame_get_buffer(frame);
+
+        LedFrameCord row;
+        for(row = 0; row < ch; row++)
+        {
+                memcpy(dst + row * stride,
+                       image->data + row * image->bytes_per_line, cw * 4);
+                memset(dst + row * stride + cw * 4, 0, (w - cw) * 4);
+        }
+
+        memset(dst + ch * stride, 0, (h - ch) * stride);
+}
+
+
+/**
+ * capture window
+ */
+static NftResult _capture(LedFrame * frame, LedFrameCord x, LedFrameCord y)
+{
+        if(!frame)
+                NFT_LOG_NULL(NFT_FAILURE);
+
+        LedFrameCord w, h;
+        if(!led_frame_get_dim(frame, &w, &h))
+                return NFT_FAILURE;
+
+        if(!_events())
+                return NFT_FAILURE;
+
+        /* nothing to capture, keep last frame */
+        if(!_c.mapped)
+                return NFT_SUCCESS;
+
+        _c.error = 0;
+        if(!_c.pixmap)
+        {
+                _c.pixmap = XCompositeNameWindowPixmap(_c.display, _c.window);
+                XSync(_c.display, False);
+                if(_c.error)
+                {
+                        NFT_LOG(L_ERROR, "Failed to get pixmap of window");
+                        _c.pixmap = None;
+                        return NFT_FAILURE;
+                }
+        }
+
+        /* part of frame covered by window */
+        LedFrameCord cw = _c.ww - x < w ? _c.ww - x : w;
+        LedFrameCord ch = _c.wh - y < h ? _c.wh - y : h;
+        if(cw < 0)
+                cw = 0;
+        if(ch < 0)
+                ch = 0;
+
+        if(!cw || !ch)
+        {
+                memset(led_frame_get_buffer(frame), 0,
+                       led_frame_get_buffersize(frame));
+                return NFT_SUCCESS;
+        }
+
+#ifdef HAVE_XSHM
+        if(_c.shm)
+        {
+                if(_c.image && (_c.image->width != w || _c.image->height != h))
+                        _shm_image_destroy();
+
+                XWindowAttributes a;
+                if(!_c.image &&
+                   (!XGetWindowAttributes(_c.display, _c.window, &a) ||
+                    !_shm_image_create(w, h, &a)))
+                        return NFT_FAILURE;
+
+                /* fetch covered part as image of that size */
+                XImage sub = *_c.image;
+                sub.width = cw;
+                sub.height = ch;
+                sub.bytes_per_line =
+                        ((cw * sub.bits_per_pixel + sub.bitmap_pad -
+                          1) / sub.bitmap_pad) * (sub.bitmap_pad / 8);
+
+                if(!XShmGetImage(_c.display, _c.pixmap, &sub, x, y,
+                                 AllPlanes))
+                {
+                        NFT_LOG(L_ERROR, "XShmGetImage() failed");
+                        _pixmap_release();
+                        return NFT_FAILURE;
+                }
+
+                _copy(frame, &sub, cw, ch);
+                return NFT_SUCCESS;
+        }
+#endif /* HAVE_XSHM */
+
+        XImage *image;
+        if(!(image = XGetImage(_c.display, _c.pixmap, x, y, cw, ch,
+                               AllPlanes, ZPixmap)))
+        {
+                NFT_LOG(L_ERROR, "XGetImage() failed");
+                /* window may have changed before we got the event */
+                _pixmap_release();
+                return NFT_FAILURE;
+        }
+
+        _copy(frame, image, cw, ch);
+        XDestroyImage(image);
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * deinitialize capture mechanism
+ */
+static void _deinit()
+{
+        if(!_c.display)
+                return;
+
+#ifdef HAVE_XSHM
+        _shm_image_destroy();
+#endif /* HAVE_XSHM */
+
+        if(_c.window)
+        {
+                _pixmap_release();
+                XCompositeUnredirectWindow(_c.display, _c.window,
+                                           CompositeRedirectAutomatic);
+                XSync(_c.display, False);
+        }
+        _c.window = None;
+
+        XCloseDisplay(_c.display);
+        _c.display = NULL;
+}
+
+
+/**
+ * initialize capture mechanism
+ */
+static NftResult _init()
+{
+        if(!_c.id && !_c.name[0] && !_c.class[0])
+        {
+                NFT_LOG(L_ERROR,
+                        "Set window to capture with -o window=, -o name= or -o class=");
+                return NFT_FAILURE;
+        }
+
+        if(!(_c.display = XOpenDisplay(NULL)))
+        {
+                NFT_LOG(L_ERROR, "Failed to open display");
+                return NFT_FAILURE;
+        }
+
+        _c.screen = DefaultScreen(_c.display);
+        XSetErrorHandler(_err_handler);
+
+        /* NameWindowPixmap needs XComposite 0.2 */
+        int event, error, major = 0, minor = 2;
+        if(!XCompositeQueryExtension(_c.display, &event, &error) ||
+           !XCompositeQueryVersion(_c.display, &major, &minor) ||
+           (major == 0 && minor < 2))
+        {
+                NFT_LOG(L_ERROR, "X server doesn't support XComposite 0.2");
+                goto _i_error;
+        }
+
+        if(!(_c.window = _c.id ? _c.id :
+             _find(RootWindow(_c.display, _c.screen))))
+        {
+                NFT_LOG(L_ERROR, "No window found (name: \"%s\", class: \"%s\")",
+                        _c.name, _c.class);
+                goto _i_error;
+        }
+
+        XWindowAttributes a;
+        _c.error = 0;
+        if(!XGetWindowAttributes(_c.display, _c.window, &a) || _c.error)
+        {
+                NFT_LOG(L_ERROR, "Invalid window 0x%lx", _c.window);
+                _c.window = None;
+                goto _i_error;
+        }
+
+        /* only 32 bit TrueColor windows */
+        if(a.depth != 24 && a.depth != 32)
+        {
+                NFT_LOG(L_ERROR, "Unsupported window depth: %d", a.depth);
+                _c.window = None;
+                goto _i_error;
+        }
+
+        _c.ww = a.width;
+        _c.wh = a.height;
+        _c.mapped = a.map_state == IsViewable;
+
+        /* follow resizes, (un)mapping & destruction */
+        XSelectInput(_c.display, _c.window, StructureNotifyMask);
+
+        /* keep window contents in offscreen pixmap */
+        XCompositeRedirectWindow(_c.display, _c.window,
+                                 CompositeRedirectAutomatic);
+
+#ifdef HAVE_XSHM
+        _c.shm = XShmQueryExtension(_c.display);
+#endif /* HAVE_XSHM */
+
+        NFT_LOG(L_INFO, "Capturing window 0x%lx (%dx%d)", _c.window, _c.ww,
+                _c.wh);
+
+        return NFT_SUCCESS;
+
+_i_error:
+        _deinit();
+        return NFT_FAILURE;
+}
+
+
+/**
+ * return frame format
+ */
+static const char *_format()
+{
+        return "ARGB u8";
+}
+
+
+/**
+ * return whether capture mechanism delivers big-endian ordered data
+ */
+static bool _is_big_endian()
+{
+        return XImageByteOrder(_c.display) == LSBFirst;
+}
+
+
+/** descriptor of this mechanism */
+CaptureMechanism COMPOSITE = {
+        .name = "XComposite",
+        .option = _option,
+        .init = _init,
+        .deinit = _deinit,
+        .capture = _capture,
+        .format = _format,
+        .is_big_endian = _is_big_endian,
+};
+
+
+#endif /* HAVE_X && HAVE_XCOMPOSITE */
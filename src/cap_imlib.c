@@ -41,10 +41,27 @@
  * Boston, MA 02111-1307, USA.
  */
 
+/**
+ * capture mechanism using Imlib2
+ *
+ * The screen is grabbed straight into an Imlib image wrapping the buffer
+ * of the frame, or - if a larger screen rectangle is set - into a
+ * persistent source image that's then scaled (anti-aliased) into the
+ * frame. No pixels are allocated per frame.
+ *
+ * options:
+ *      width   width of screen rectangle to scale from (default: same as
+ *              frame, no scaling)
+ *      height  height of screen rectangle to scale from (default: same as
+ *              frame, no scaling)
+ */
+
 #include "config.h"
 
 #ifdef HAVE_IMLIB
 
+#include <stdlib.h>
+#include <string.h>
 #include <X11/Xutil.h>
 #include <X11/Xlib.h>
 #include <Imlib2.h>
@@ -52,6 +69,8 @@
 #include "capture.h"
 
 
+/** amount of frame buffers we keep images for (pipelined mode) */
+#define IMAGES_MAX 8
 
 
 /** private structure to hold info accros function-calls */
@@ -63,11 +82,138 @@ static struct
         Colormap colormap;
         int depth;
         Window root;
+        /** width of screen rectangle (0 = frame width) */
+        LedFrameCord width;
+        /** height of screen rectangle (0 = frame height) */
+        LedFrameCord height;
+        /** images wrapping buffers of frames */
+        struct
+        {
+                Imlib_Image image;
+                void *buffer;
+                LedFrameCord w, h;
+        } images[IMAGES_MAX];
+        /** next slot of images to replace */
+        int next;
+        /** image screen is grabbed into before scaling */
+        Imlib_Image source;
+        /** dimensions of source */
+        LedFrameCord sw, sh;
 } _c;
 
 
 
 
+/**
+ * set option
+ */
+static NftResult _option(const char *key, const char *value)
+{
+        if(strcmp(key, "width") == 0)
+        {
+                if((_c.width = atoi(value)) < 0)
+                {
+                        NFT_LOG(L_ERROR, "Invalid width: %s", value);
+                        return NFT_FAILURE;
+                }
+        }
+        else if(strcmp(key, "height") == 0)
+        {
+                if((_c.height = atoi(value)) < 0)
+                {
+                        NFT_LOG(L_ERROR, "Invalid height: %s", value);
+                        return NFT_FAILURE;
+                }
+        }
+        else
+        {
+                NFT_LOG(L_ERROR, "Unknown option \"%s\"", key);
+                return NFT_FAILURE;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * free an image (doesn't free data of images wrapping frames)
+ */
+static void _image_free(Imlib_Image image)
+{
+        if(!image)
+                return;
+
+        imlib_context_set_image(image);
+        imlib_free_image();
+}
+
+
+/**
+ * get image that uses the buffer of frame as data
+ */
+static Imlib_Image _frame_image(LedFrame * frame, LedFrameCord w,
+                                LedFrameCord h)
+{
+        void *buffer = led_frame_get_buffer(frame);
+
+        int i;
+        for(i = 0; i < IMAGES_MAX; i++)
+        {
+                if(_c.images[i].image && _c.images[i].buffer == buffer &&
+                   _c.images[i].w == w && _c.images[i].h == h)
+                        return _c.images[i].image;
+        }
+
+        /* replace oldest image */
+        i = _c.next;
+        _c.next = (_c.next + 1) % IMAGES_MAX;
+        _image_free(_c.images[i].image);
+        _c.images[i].image = NULL;
+
+        Imlib_Image image;
+        if(!(image = imlib_create_image_using_data(w, h, buffer)))
+        {
+                NFT_LOG(L_ERROR, "Failed to create Imlib_Image for frame");
+                return NULL;
+        }
+
+        imlib_context_set_image(image);
+        imlib_image_set_has_alpha(0);
+
+        _c.images[i].image = image;
+        _c.images[i].buffer = buffer;
+        _c.images[i].w = w;
+        _c.images[i].h = h;
+
+        return image;
+}
+
+
+/**
+ * get persistent image of w x h pixels to grab into before scaling
+ */
+static Imlib_Image _source_image(LedFrameCord w, LedFrameCord h)
+{
+        if(_c.source && _c.sw == w && _c.sh == h)
+                return _c.source;
+
+        _image_free(_c.source);
+
+        if(!(_c.source = imlib_create_image(w, h)))
+        {
+                NFT_LOG(L_ERROR, "Failed to create %dx%d Imlib_Image", w, h);
+                return NULL;
+        }
+
+        imlib_context_set_image(_c.source);
+        imlib_image_set_has_alpha(0);
+
+        _c.sw = w;
+        _c.sh = h;
+
+        return _c.source;
+}
+
 
 /**
  * capture image at x/y and store in frame
@@ -77,54 +223,46 @@ static NftResult _capture(LedFrame * frame, LedFrameCord x, LedFrameCord y)
         if(!frame)
                 NFT_LOG_NULL(NFT_FAILURE);
 
-		/* get frame dimensions */
-		LedFrameCord w, h;
-		if(!led_frame_get_dim(frame, &w, &h))
-				return NFT_FAILURE;
-		
-        /* get screen-portion from X server */
-        XImage *image = NULL;
-
-        if(!
-           (image =
-            XGetImage(_c.display, _c.root, x, y, w, h, AllPlanes, ZPixmap)))
-        {
-                NFT_LOG(L_ERROR, "Failed to capture XImage");
+        /* get frame dimensions */
+        LedFrameCord w, h;
+        if(!led_frame_get_dim(frame, &w, &h))
                 return NFT_FAILURE;
-        }
-		
-        /* convert image to 32 bit RGB */
-        Imlib_Image *iimg;
-
-        if(!
-           (iimg =
-            imlib_create_image_from_ximage(image, NULL, 0, 0, w, h,
-                                           true)))
-        {
-                NFT_LOG(L_ERROR, "Failed to create Imlib_Image from XImage");
+
+        /* size of screen rectangle */
+        LedFrameCord sw = _c.width ? _c.width : w;
+        LedFrameCord sh = _c.height ? _c.height : h;
+
+        Imlib_Image dst;
+        if(!(dst = _frame_image(frame, w, h)))
                 return NFT_FAILURE;
+
+        /* grab straight into frame */
+        if(sw == w && sh == h)
+        {
+                imlib_context_set_image(dst);
+                if(!imlib_copy_drawable_to_image(0, x, y, w, h, 0, 0, 0))
+                {
+                        NFT_LOG(L_ERROR, "Failed to capture screen");
+                        return NFT_FAILURE;
+                }
+
+                return NFT_SUCCESS;
         }
 
-        /* get data */
-        DATA32 *data;
+        /* grab into source & scale to frame */
+        Imlib_Image src;
+        if(!(src = _source_image(sw, sh)))
+                return NFT_FAILURE;
 
-        imlib_context_set_image(iimg);
-        if(!(data = imlib_image_get_data_for_reading_only()))
+        imlib_context_set_image(src);
+        if(!imlib_copy_drawable_to_image(0, x, y, sw, sh, 0, 0, 0))
         {
-                NFT_LOG(L_ERROR, "Failed to get data from Imlib_Image");
+                NFT_LOG(L_ERROR, "Failed to capture screen");
                 return NFT_FAILURE;
         }
 
-        /* copy data to our frame */
-        memcpy(led_frame_get_buffer(frame), data,
-               led_frame_get_buffersize(frame));
-        /* if(!led_frame_buffer_convert(frame, data, "RGBA u8",
-         * led_frame_get_width(frame)* led_frame_get_height(frame))) return
-         * NFT_FAILURE; */
-
-        /* destroy images */
-        imlib_free_image();
-        XDestroyImage(image);
+        imlib_context_set_image(dst);
+        imlib_blend_image_onto_image(src, 0, 0, 0, sw, sh, 0, 0, w, h);
 
         return NFT_SUCCESS;
 }
@@ -172,8 +310,13 @@ static NftResult _init()
         imlib_context_set_display(_c.display);
         imlib_context_set_visual(_c.visual);
         imlib_context_set_colormap(_c.colormap);
+        imlib_context_set_drawable(_c.root);
         imlib_context_set_color_modifier(NULL);
         imlib_context_set_operation(IMLIB_OP_COPY);
+        /* replace pixels of frame instead of blending onto them */
+        imlib_context_set_blend(0);
+        /* average pixels when scaling down */
+        imlib_context_set_anti_alias(1);
 
         return NFT_SUCCESS;
 }
@@ -184,15 +327,27 @@ static NftResult _init()
  */
 static void _deinit()
 {
+        int i;
+        for(i = 0; i < IMAGES_MAX; i++)
+        {
+                _image_free(_c.images[i].image);
+                _c.images[i].image = NULL;
+        }
+
+        _image_free(_c.source);
+        _c.source = NULL;
+
         /* close X display */
         if(_c.display)
                 XCloseDisplay(_c.display);
+        _c.display = NULL;
 }
 
 
 /** descriptor of this mechanism */
 CaptureMechanism IMLIB = {
         .name = "Imlib2",
+        .option = _option,
         .init = _init,
         .deinit = _deinit,
         .capture = _capture,
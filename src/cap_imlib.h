@@ -47,7 +47,7 @@
 
 
 /** declaration of our descriptor */
-CaptureMechanism                IMLIB;
+extern CaptureMechanism         IMLIB;
 
 
 
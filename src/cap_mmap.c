@@ -0,0 +1,431 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * capture from a memory-mapped raw pixel source without X.
+ *
+ * The source is a linux framebuffer device (geometry & format are queried
+ * from the driver) or any file/shared-memory object holding an image of
+ * known geometry. Capturing is a strided copy of the requested rectangle
+ * out of the mapping.
+ *
+ * Options:
+ *   file=<path>      source to map (default: /dev/fb0)
+ *   width=<n>        width of source in pixels
+ *   height=<n>       height of source in pixels
+ *   stride=<n>       bytes per line (default: width * bytes per pixel)
+ *   offset=<n>       bytes to skip at start of source (default: 0)
+ *   format=<format>  niftyled pixel-format of source (default: "ARGB u8")
+ *   bigendian=0|1    byte-order of pixels in source (default: 0)
+ *
+ * width, height & format are ignored for framebuffer devices.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#ifdef HAVE_LINUX_FB_H
+#include <linux/fb.h>
+#endif /* HAVE_LINUX_FB_H */
+#include <niftyled.h>
+#include "capture.h"
+#include "cap_mmap.h"
+
+
+
+/** private structure to hold info accros function-calls */
+static struct
+{
+        /** filename of source */
+        char file[256];
+        /** descriptor of source */
+        int fd;
+        /** true if source is a framebuffer device */
+        bool fbdev;
+        /** mapping of source */
+        uint8_t *map;
+        /** size of mapping */
+        size_t size;
+        /** width of source */
+        LedFrameCord width;
+        /** height of source */
+        LedFrameCord height;
+        /** bytes per line of source */
+        size_t stride;
+        /** offset of first pixel in mapping */
+        size_t offset;
+        /** bytes per pixel */
+        size_t bpp;
+        /** pixel-format of source */
+        char format[64];
+        /** byte-order of source */
+        bool big_endian;
+} _c = {
+        .file = "/dev/fb0",
+        .fd = -1,
+        .format = "ARGB u8",
+};
+
+
+
+
+/** parse unsigned integer option */
+static NftResult _uint(const char *key, const char *value, long *result)
+{
+        char *end;
+        *result = strtol(value, &end, 0);
+        if(*end || *result < 0)
+        {
+                NFT_LOG(L_ERROR, "Invalid %s \"%s\" (Use a positive integer)",
+                        key, value);
+                return NFT_FAILURE;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+#ifdef HAVE_LINUX_FB_H
+/** query geometry & format of framebuffer device */
+static NftResult _fb_info()
+{
+        struct fb_var_screeninfo var;
+        struct fb_fix_screeninfo fix;
+
+        if(ioctl(_c.fd, FBIOGET_VSCREENINFO, &var) < 0 ||
+           ioctl(_c.fd, FBIOGET_FSCREENINFO, &fix) < 0)
+        {
+                NFT_LOG_PERROR("ioctl()");
+                return NFT_FAILURE;
+        }
+
+        _c.width = var.xres;
+        _c.height = var.yres;
+        _c.stride = fix.line_length;
+        _c.size = fix.smem_len;
+        _c.bpp = var.bits_per_pixel / 8;
+
+        NFT_LOG(L_VERBOSE, "Framebuffer %s: %dx%d, %d bpp, stride %zu, "
+                "red %d/%d green %d/%d blue %d/%d", fix.id, _c.width,
+                _c.height, var.bits_per_pixel, _c.stride, var.red.offset,
+                var.red.length, var.green.offset, var.green.length,
+                var.blue.offset, var.blue.length);
+
+        /* pixels are little-endian words, describe them from the MSB */
+        if(var.red.length != 8 || var.green.length != 8 ||
+           var.blue.length != 8)
+        {
+                NFT_LOG(L_ERROR,
+                        "Only framebuffers with 8 bits per component are supported");
+                return NFT_FAILURE;
+        }
+
+        bool rgb = var.red.offset > var.blue.offset;
+        switch (var.bits_per_pixel)
+        {
+                case 32:
+                {
+                        strcpy(_c.format, rgb ? "ARGB u8" : "ABGR u8");
+                        break;
+                }
+
+                case 24:
+                {
+                        strcpy(_c.format, rgb ? "RGB u8" : "BGR u8");
+                        break;
+                }
+
+                default:
+                {
+                        NFT_LOG(L_ERROR, "Unsupported bits per pixel: %d",
+                                var.bits_per_pixel);
+                        return NFT_FAILURE;
+                }
+        }
+
+        /* same convention as Xlib mechanism */
+        _c.big_endian = true;
+
+        return NFT_SUCCESS;
+}
+#endif /* HAVE_LINUX_FB_H */
+
+
+/** offset of first visible pixel (framebuffers may be panned) */
+static size_t _origin()
+{
+#ifdef HAVE_LINUX_FB_H
+        struct fb_var_screeninfo var;
+        if(_c.fbdev && ioctl(_c.fd, FBIOGET_VSCREENINFO, &var) == 0)
+                return var.yoffset * _c.stride + var.xoffset * _c.bpp;
+#endif /* HAVE_LINUX_FB_H */
+
+        return _c.offset;
+}
+
+
+/******************************************************************************/
+
+/** set option */
+static NftResult _option(const char *key, const char *value)
+{
+        long v;
+
+        if(strcmp(key, "file") == 0)
+        {
+                if(strlen(value) >= sizeof(_c.file))
+                {
+                        NFT_LOG(L_ERROR, "Filename \"%s\" too long", value);
+                        return NFT_FAILURE;
+                }
+                strcpy(_c.file, value);
+        }
+        else if(strcmp(key, "format") == 0)
+        {
+                if(strlen(value) >= sizeof(_c.format))
+                {
+                        NFT_LOG(L_ERROR, "Format \"%s\" too long", value);
+                        return NFT_FAILURE;
+                }
+                strcpy(_c.format, value);
+        }
+        else if(strcmp(key, "bigendian") == 0)
+        {
+                _c.big_endian = atoi(value) != 0;
+        }
+        else
+        {
+                if(!_uint(key, value, &v))
+                        return NFT_FAILURE;
+
+                if(strcmp(key, "width") == 0)
+                        _c.width = v;
+                else if(strcmp(key, "height") == 0)
+                        _c.height = v;
+                else if(strcmp(key, "stride") == 0)
+                        _c.stride = v;
+                else if(strcmp(key, "offset") == 0)
+                        _c.offset = v;
+                else
+                {
+                        NFT_LOG(L_ERROR, "Unknown option \"%s\"", key);
+                        return NFT_FAILURE;
+                }
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/** initialize this capture mechanism */
+static NftResult _init()
+{
+        if((_c.fd = open(_c.file, O_RDONLY)) < 0)
+        {
+                NFT_LOG(L_ERROR, "Failed to open \"%s\"", _c.file);
+                NFT_LOG_PERROR("open()");
+                return NFT_FAILURE;
+        }
+
+        struct stat st;
+        if(fstat(_c.fd, &st) < 0)
+        {
+                NFT_LOG_PERROR("fstat()");
+                goto _i_error;
+        }
+
+        _c.fbdev = S_ISCHR(st.st_mode);
+        if(_c.fbdev)
+        {
+#ifdef HAVE_LINUX_FB_H
+                if(!_fb_info())
+                        goto _i_error;
+#else
+                NFT_LOG(L_ERROR, "Framebuffer devices are not supported");
+                goto _i_error;
+#endif /* HAVE_LINUX_FB_H */
+        }
+        else
+        {
+                if(_c.width <= 0 || _c.height <= 0)
+                {
+                        NFT_LOG(L_ERROR,
+                                "Geometry of \"%s\" unknown (Use -o width=<w> -o height=<h>)",
+                                _c.file);
+                        goto _i_error;
+                }
+
+                if(!(_c.bpp = led_pixel_format_get_bytes_per_pixel
+                     (led_pixel_format_from_string(_c.format))))
+                {
+                        NFT_LOG(L_ERROR, "Invalid format \"%s\"", _c.format);
+                        goto _i_error;
+                }
+
+                if(!_c.stride)
+                        _c.stride = _c.width * _c.bpp;
+
+                _c.size = _c.offset + _c.height * _c.stride;
+                if((size_t) st.st_size < _c.size)
+                {
+                        NFT_LOG(L_ERROR,
+                                "\"%s\" too small (%lld bytes, %zu needed)",
+                                _c.file, (long long) st.st_size, _c.size);
+                        goto _i_error;
+                }
+        }
+
+        if((_c.map = mmap(NULL, _c.size, PROT_READ, MAP_SHARED, _c.fd, 0))
+           == MAP_FAILED)
+        {
+                _c.map = NULL;
+                NFT_LOG_PERROR("mmap()");
+                goto _i_error;
+        }
+
+        return NFT_SUCCESS;
+
+_i_error:
+        close(_c.fd);
+        _c.fd = -1;
+        return NFT_FAILURE;
+}
+
+
+/** deinitialize this capture mechanism */
+static void _deinit()
+{
+        if(_c.map)
+        {
+                munmap(_c.map, _c.size);
+                _c.map = NULL;
+        }
+
+        if(_c.fd >= 0)
+        {
+                close(_c.fd);
+                _c.fd = -1;
+        }
+}
+
+
+/** copy rectangle at x/y out of the mapping */
+static NftResult _capture(LedFrame * frame, LedFrameCord x, LedFrameCord y)
+{
+        if(!frame)
+                NFT_LOG_NULL(NFT_FAILURE);
+
+        LedFrameCord w, h;
+        if(!led_frame_get_dim(frame, &w, &h))
+                return NFT_FAILURE;
+
+        if(x + w > _c.width || y + h > _c.height)
+        {
+                NFT_LOG(L_ERROR,
+                        "Capture rectangle %dx%d at %d/%d exceeds source (%dx%d)",
+                        w, h, x, y, _c.width, _c.height);
+                return NFT_FAILURE;
+        }
+
+        size_t origin = _origin();
+        uint8_t *src = _c.map + origin + y * _c.stride + x * _c.bpp;
+        uint8_t *dst = led_frame_get_buffer(frame);
+        size_t line = w * _c.bpp;
+
+        if(origin + (y + h - 1) * _c.stride + (x + w) * _c.bpp > _c.size)
+        {
+                NFT_LOG(L_ERROR, "Capture rectangle exceeds mapping");
+                return NFT_FAILURE;
+        }
+
+        /* whole lines can be copied at once */
+        if(line == _c.stride)
+        {
+                memcpy(dst, src, h * line);
+                return NFT_SUCCESS;
+        }
+
+        LedFrameCord i;
+        for(i = 0; i < h; i++)
+        {
+                memcpy(dst, src, line);
+                dst += line;
+                src += _c.stride;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/** return pixel-format of source */
+static const char *_format()
+{
+        return _c.format;
+}
+
+
+/** return byte-order of source */
+static bool _is_big_endian()
+{
+        return _c.big_endian;
+}
+
+
+/** descriptor of mmap mechanism */
+CaptureMechanism MMAP = {
+        .name = "mmap",
+        .option = _option,
+        .init = _init,
+        .deinit = _deinit,
+        .capture = _capture,
+        .format = _format,
+        .is_big_endian = _is_big_endian,
+};
@@ -0,0 +1,397 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * synthetic capture mechanism that renders test-patterns instead of
+ * capturing a display.
+ *
+ * Patterns move by "speed" pixels per captured frame, so output only
+ * depends on the amount of frames captured. Every component of the frame
+ * format is rendered, 8 or 16 bits per component are supported.
+ *
+ * Options:
+ *   pattern=gradient|checker|noise (default: gradient)
+ *   format=<niftyled pixel-format> (default: "RGB u8")
+ *   cell=<n>      size of checkerboard cells in pixels (default: 16)
+ *   speed=<n>     pixels the pattern moves per frame (default: 1)
+ *   counter=0|1   draw frame counter as 32 blocks in the top row (default: 1)
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <niftyled.h>
+#include "capture.h"
+#include "cap_pattern.h"
+
+
+/** available patterns */
+typedef enum
+{
+        PATTERN_GRADIENT = 0,
+        PATTERN_CHECKER,
+        PATTERN_NOISE,
+} Pattern;
+
+
+/** private structure to hold info accros function-calls */
+static struct
+{
+        /** pattern to render */
+        Pattern pattern;
+        /** pixel-format of frames */
+        char format[64];
+        /** size of checkerboard cells */
+        int cell;
+        /** pixels to move per frame */
+        int speed;
+        /** draw frame counter */
+        bool counter;
+        /** amount of frames rendered */
+        uint32_t frames;
+        /** state of noise generator */
+        uint32_t seed;
+        /** one row of 8 bit components */
+        uint8_t *line;
+        /** rendered rows of frame format (2 for checkerboard) */
+        uint8_t *rows;
+        /** width the buffers are allocated for */
+        LedFrameCord width;
+        /** bytes per pixel the buffers are allocated for */
+        size_t bpp;
+} _c = {
+        .format = "RGB u8",
+        .cell = 16,
+        .speed = 1,
+        .counter = true,
+};
+
+
+
+
+/** (re)allocate row buffers */
+static NftResult _alloc(LedFrameCord w, size_t comps, size_t bpp)
+{
+        if(w == _c.width && bpp == _c.bpp)
+                return NFT_SUCCESS;
+
+        free(_c.line);
+        _c.line = NULL;
+        free(_c.rows);
+        _c.rows = NULL;
+        _c.width = 0;
+
+        if(!(_c.line = malloc(w * comps)) ||
+           !(_c.rows = malloc(2 * w * bpp)))
+        {
+                NFT_LOG_PERROR("malloc()");
+                return NFT_FAILURE;
+        }
+
+        _c.width = w;
+        _c.bpp = bpp;
+
+        return NFT_SUCCESS;
+}
+
+
+/** convert n 8 bit values (+ add) to components of frame-format */
+static void _expand(uint8_t * dst, uint8_t * src, size_t n, size_t bpc,
+                    uint8_t add)
+{
+        size_t i;
+
+        if(bpc == 1)
+        {
+                for(i = 0; i < n; i++)
+                        dst[i] = src[i] + add;
+                return;
+        }
+
+        uint16_t *d = (uint16_t *) dst;
+        for(i = 0; i < n; i++)
+                d[i] = (uint8_t) (src[i] + add) * 257;
+}
+
+
+/** render line of checkerboard with phase 0 or 1 */
+static void _checker_line(LedFrameCord w, size_t comps, int offset, int phase)
+{
+        LedFrameCord x;
+        for(x = 0; x < w; x++)
+        {
+                uint8_t v = (((x + offset) / _c.cell + phase) & 1) ? 0xff : 0;
+                memset(&_c.line[x * comps], v, comps);
+        }
+}
+
+
+/** fill 32 bit words with noise (xorshift) */
+static void _noise(uint8_t * buf, size_t size)
+{
+        uint32_t s = _c.seed, v;
+        size_t i;
+        for(i = 0; i + sizeof(v) <= size; i += sizeof(v))
+        {
+                s ^= s << 13;
+                s ^= s >> 17;
+                s ^= s << 5;
+                memcpy(&buf[i], &s, sizeof(v));
+        }
+        for(; i < size; i++)
+                buf[i] = s >> (8 * (i % sizeof(v)));
+
+        _c.seed = s;
+}
+
+
+/** draw frame counter in top row of frame */
+static void _draw_counter(uint8_t * buf, LedFrameCord w, LedFrameCord h,
+                          size_t bpp)
+{
+        LedFrameCord bw = w >= 32 ? w / 32 : 1;
+        LedFrameCord bh = h >= 16 ? h / 16 : 1;
+
+        LedFrameCord y;
+        for(y = 0; y < bh; y++)
+        {
+                int bit;
+                for(bit = 0; bit < 32 && bit * bw < w; bit++)
+                {
+                        uint8_t v = (_c.frames >> (31 - bit)) & 1 ? 0xff : 0;
+                        memset(&buf[(y * w + bit * bw) * bpp], v, bw * bpp);
+                }
+        }
+}
+
+
+/******************************************************************************/
+
+/** set option */
+static NftResult _option(const char *key, const char *value)
+{
+        if(strcmp(key, "pattern") == 0)
+        {
+                if(strcmp(value, "gradient") == 0)
+                        _c.pattern = PATTERN_GRADIENT;
+                else if(strcmp(value, "checker") == 0)
+                        _c.pattern = PATTERN_CHECKER;
+                else if(strcmp(value, "noise") == 0)
+                        _c.pattern = PATTERN_NOISE;
+                else
+                {
+                        NFT_LOG(L_ERROR,
+                                "Unknown pattern \"%s\" (Use gradient, checker or noise)",
+                                value);
+                        return NFT_FAILURE;
+                }
+        }
+        else if(strcmp(key, "format") == 0)
+        {
+                if(strlen(value) >= sizeof(_c.format))
+                {
+                        NFT_LOG(L_ERROR, "Format \"%s\" too long", value);
+                        return NFT_FAILURE;
+                }
+                strcpy(_c.format, value);
+        }
+        else if(strcmp(key, "cell") == 0)
+        {
+                if((_c.cell = atoi(value)) <= 0)
+                {
+                        NFT_LOG(L_ERROR, "Invalid cell size \"%s\"", value);
+                        return NFT_FAILURE;
+                }
+        }
+        else if(strcmp(key, "speed") == 0)
+        {
+                _c.speed = atoi(value);
+        }
+        else if(strcmp(key, "counter") == 0)
+        {
+                _c.counter = atoi(value) != 0;
+        }
+        else
+        {
+                NFT_LOG(L_ERROR, "Unknown option \"%s\"", key);
+                return NFT_FAILURE;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/** initialize this capture mechanism */
+static NftResult _init()
+{
+        _c.frames = 0;
+        _c.seed = 0x12345678;
+        _c.width = 0;
+
+        return NFT_SUCCESS;
+}
+
+
+/** deinitialize this capture mechanism */
+static void _deinit()
+{
+        free(_c.line);
+        _c.line = NULL;
+        free(_c.rows);
+        _c.rows = NULL;
+        _c.width = 0;
+}
+
+
+/** render pattern into frame */
+static NftResult _capture(LedFrame * frame, LedFrameCord ox, LedFrameCord oy)
+{
+        if(!frame)
+                NFT_LOG_NULL(NFT_FAILURE);
+
+        LedFrameCord w, h;
+        if(!led_frame_get_dim(frame, &w, &h))
+                return NFT_FAILURE;
+
+        LedPixelFormat *f = led_frame_get_format(frame);
+        size_t bpp = led_pixel_format_get_bytes_per_pixel(f);
+        size_t comps = led_pixel_format_get_n_components(f);
+        size_t bpc = comps ? bpp / comps : 0;
+        if(bpc != 1 && bpc != 2)
+        {
+                NFT_LOG(L_ERROR,
+                        "Pixel-format \"%s\" not supported (only 8 or 16 bit per component)",
+                        led_pixel_format_to_string(f));
+                return NFT_FAILURE;
+        }
+
+        if(!_alloc(w, comps, bpp))
+                return NFT_FAILURE;
+
+        uint8_t *buf = led_frame_get_buffer(frame);
+        size_t stride = w * bpp;
+        int offset = _c.frames * _c.speed;
+        LedFrameCord x, y;
+
+        switch (_c.pattern)
+        {
+                /* diagonal gradient, components phase-shifted */
+                case PATTERN_GRADIENT:
+                {
+                        /* rows only differ by a constant */
+                        int scale = w + h;
+                        uint8_t *l = _c.line;
+                        for(x = 0; x < w; x++)
+                        {
+                                int v = ((ox + x) * 256) / scale;
+                                size_t c;
+                                for(c = 0; c < comps; c++)
+                                        *l++ = v + c * 85;
+                        }
+
+                        for(y = 0; y < h; y++)
+                                _expand(&buf[y * stride], _c.line, w * comps,
+                                        bpc, ((oy + y) * 256) / scale + offset);
+                        break;
+                }
+
+                /* checkerboard, only two different rows exist */
+                case PATTERN_CHECKER:
+                {
+                        int phase;
+                        for(phase = 0; phase < 2; phase++)
+                        {
+                                _checker_line(w, comps, ox + offset, phase);
+                                _expand(&_c.rows[phase * stride], _c.line,
+                                        w * comps, bpc, 0);
+                        }
+
+                        for(y = 0; y < h; y++)
+                                memcpy(&buf[y * stride],
+                                       &_c.rows[(((oy + y) / _c.cell) & 1) *
+                                                stride], stride);
+                        break;
+                }
+
+                /* white noise */
+                case PATTERN_NOISE:
+                {
+                        _noise(buf, h * stride);
+                        break;
+                }
+        }
+
+        if(_c.counter)
+                _draw_counter(buf, w, h, bpp);
+
+        _c.frames++;
+
+        return NFT_SUCCESS;
+}
+
+
+/** return pixel-format of rendered frames */
+static const char *_format()
+{
+        return _c.format;
+}
+
+
+/** patterns are rendered in host byte-order */
+static bool _is_big_endian()
+{
+        const uint16_t one = 1;
+        return *(const uint8_t *) &one == 0;
+}
+
+
+/** descriptor of test-pattern mechanism */
+CaptureMechanism PATTERN = {
+        .name = "pattern",
+        .option = _option,
+        .init = _init,
+        .deinit = _deinit,
+        .capture = _capture,
+        .format = _format,
+        .is_big_endian = _is_big_endian,
+};
@@ -0,0 +1,439 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * capture raw frames from a pipe, e.g.
+ *   ffmpeg -i video.mkv -f rawvideo -pix_fmt bgra -s 320x240 - | ledcap -m pipe
+ *
+ * The descriptor is read non-blocking, every capture consumes everything
+ * that arrived and uses the newest complete frame, so a producer that is
+ * faster than ledcap doesn't build up latency. If no new frame arrived,
+ * the last one is used again. Regular files are played back frame by
+ * frame instead. Capturing fails at end of stream, which ends the
+ * main-loop.
+ *
+ * Options:
+ *   file=<path>      read from file or fifo instead of stdin
+ *   fd=<n>           read from this descriptor (default: 0)
+ *   width=<n>        width of stream (default: width of frame)
+ *   height=<n>       height of stream (default: height of frame)
+ *   format=<format>  niftyled pixel-format of stream (default: "ARGB u8")
+ *   bigendian=0|1    byte-order of stream (default: 1, as -pix_fmt bgra)
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <niftyled.h>
+#include "capture.h"
+#include "cap_pipe.h"
+
+
+
+/** private structure to hold info accros function-calls */
+static struct
+{
+        /** file to read from (empty = use fd) */
+        char file[256];
+        /** descriptor to read from */
+        int fd;
+        /** true if we opened fd ourselves */
+        bool opened;
+        /** true if fd is a regular file */
+        bool regular;
+        /** file status flags of fd before we made it non-blocking (-1 =
+            unchanged) */
+        int flags;
+        /** true when end of stream was reached */
+        bool eof;
+        /** width of stream */
+        LedFrameCord width;
+        /** height of stream */
+        LedFrameCord height;
+        /** pixel-format of stream */
+        char format[64];
+        /** byte-order of stream */
+        bool big_endian;
+        /** bytes per pixel */
+        size_t bpp;
+        /** bytes per frame */
+        size_t size;
+        /** frame currently being read */
+        uint8_t *partial;
+        /** bytes of partial frame read so far */
+        size_t fill;
+        /** newest complete frame */
+        uint8_t *latest;
+        /** true once a complete frame was read */
+        bool valid;
+} _c = {
+        .fd = STDIN_FILENO,
+        .flags = -1,
+        .format = "ARGB u8",
+        .big_endian = true,
+};
+
+
+
+
+/** allocate frame buffers once size of stream is known */
+static NftResult _alloc(LedFrameCord w, LedFrameCord h)
+{
+        if(!_c.width)
+                _c.width = w;
+        if(!_c.height)
+                _c.height = h;
+
+        if(!(_c.bpp = led_pixel_format_get_bytes_per_pixel
+             (led_pixel_format_from_string(_c.format))))
+        {
+                NFT_LOG(L_ERROR, "Invalid format \"%s\"", _c.format);
+                return NFT_FAILURE;
+        }
+
+        size_t size = _c.width * _c.height * _c.bpp;
+        if(!(_c.partial = malloc(size)) || !(_c.latest = malloc(size)))
+        {
+                NFT_LOG_PERROR("malloc()");
+                free(_c.partial);
+                _c.partial = NULL;
+                return NFT_FAILURE;
+        }
+
+        /* buffers are only valid once both exist */
+        _c.size = size;
+
+        NFT_LOG(L_VERBOSE, "Reading %dx%d frames (%s, %zu bytes)",
+                _c.width, _c.height, _c.format, _c.size);
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * read what's available, keep newest complete frame
+ *
+ * @param frames read at most this many frames (0 = unlimited)
+ * @result amount of complete frames read, -1 on error
+ */
+static int _read(int frames)
+{
+        int complete = 0;
+
+        while(!frames || complete < frames)
+        {
+                ssize_t r = read(_c.fd, _c.partial + _c.fill,
+                                 _c.size - _c.fill);
+                if(r < 0)
+                {
+                        if(errno == EINTR)
+                                continue;
+                        if(errno == EAGAIN || errno == EWOULDBLOCK)
+                                break;
+                        NFT_LOG_PERROR("read()");
+                        return -1;
+                }
+
+                if(r == 0)
+                {
+                        _c.eof = true;
+                        break;
+                }
+
+                if((_c.fill += r) < _c.size)
+                        continue;
+
+                /* frame complete */
+                uint8_t *t = _c.latest;
+                _c.latest = _c.partial;
+                _c.partial = t;
+                _c.fill = 0;
+                _c.valid = true;
+                complete++;
+        }
+
+        return complete;
+}
+
+
+/** wait until stream becomes readable */
+static NftResult _wait()
+{
+        struct pollfd p = {.fd = _c.fd,.events = POLLIN };
+        while(poll(&p, 1, -1) < 0)
+        {
+                if(errno != EINTR)
+                {
+                        NFT_LOG_PERROR("poll()");
+                        return NFT_FAILURE;
+                }
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/******************************************************************************/
+
+/** set option */
+static NftResult _option(const char *key, const char *value)
+{
+        if(strcmp(key, "file") == 0)
+        {
+                if(strlen(value) >= sizeof(_c.file))
+                {
+                        NFT_LOG(L_ERROR, "Filename \"%s\" too long", value);
+                        return NFT_FAILURE;
+                }
+                strcpy(_c.file, value);
+        }
+        else if(strcmp(key, "format") == 0)
+        {
+                if(strlen(value) >= sizeof(_c.format))
+                {
+                        NFT_LOG(L_ERROR, "Format \"%s\" too long", value);
+                        return NFT_FAILURE;
+                }
+                strcpy(_c.format, value);
+        }
+        else if(strcmp(key, "bigendian") == 0)
+        {
+                _c.big_endian = atoi(value) != 0;
+        }
+        else if(strcmp(key, "fd") == 0)
+        {
+                if((_c.fd = atoi(value)) < 0)
+                {
+                        NFT_LOG(L_ERROR, "Invalid descriptor \"%s\"", value);
+                        return NFT_FAILURE;
+                }
+        }
+        else if(strcmp(key, "width") == 0)
+        {
+                if((_c.width = atoi(value)) <= 0)
+                {
+                        NFT_LOG(L_ERROR, "Invalid width \"%s\"", value);
+                        return NFT_FAILURE;
+                }
+        }
+        else if(strcmp(key, "height") == 0)
+        {
+                if((_c.height = atoi(value)) <= 0)
+                {
+                        NFT_LOG(L_ERROR, "Invalid height \"%s\"", value);
+                        return NFT_FAILURE;
+                }
+        }
+        else
+        {
+                NFT_LOG(L_ERROR, "Unknown option \"%s\"", key);
+                return NFT_FAILURE;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/** initialize this capture mechanism */
+static NftResult _init()
+{
+        if(_c.file[0])
+        {
+                if((_c.fd = open(_c.file, O_RDONLY)) < 0)
+                {
+                        NFT_LOG(L_ERROR, "Failed to open \"%s\"", _c.file);
+                        NFT_LOG_PERROR("open()");
+                        return NFT_FAILURE;
+                }
+                _c.opened = true;
+        }
+
+        struct stat st;
+        if(fstat(_c.fd, &st) < 0)
+        {
+                NFT_LOG_PERROR("fstat()");
+                return NFT_FAILURE;
+        }
+        _c.regular = S_ISREG(st.st_mode);
+
+        /* never wait for a producer in the main-loop (fd may be shared
+           with our parent, so remember how it was) */
+        if(!_c.regular)
+        {
+                int flags;
+                if((flags = fcntl(_c.fd, F_GETFL)) < 0 ||
+                   fcntl(_c.fd, F_SETFL, flags | O_NONBLOCK) < 0)
+                {
+                        NFT_LOG_PERROR("fcntl()");
+                        return NFT_FAILURE;
+                }
+                _c.flags = flags;
+        }
+
+        _c.eof = false;
+        _c.valid = false;
+        _c.fill = 0;
+
+        return NFT_SUCCESS;
+}
+
+
+/** deinitialize this capture mechanism */
+static void _deinit()
+{
+        /* leave fd blocking again for whoever else uses it */
+        if(_c.flags >= 0)
+        {
+                if(fcntl(_c.fd, F_SETFL, _c.flags) < 0)
+                        NFT_LOG_PERROR("fcntl()");
+                _c.flags = -1;
+        }
+
+        if(_c.opened)
+        {
+                close(_c.fd);
+                _c.opened = false;
+        }
+
+        free(_c.partial);
+        _c.partial = NULL;
+        free(_c.latest);
+        _c.latest = NULL;
+        _c.size = 0;
+}
+
+
+/** copy newest frame of stream into frame */
+static NftResult _capture(LedFrame * frame, LedFrameCord x, LedFrameCord y)
+{
+        if(!frame)
+                NFT_LOG_NULL(NFT_FAILURE);
+
+        LedFrameCord w, h;
+        if(!led_frame_get_dim(frame, &w, &h))
+                return NFT_FAILURE;
+
+        if(!_c.size && !_alloc(w, h))
+                return NFT_FAILURE;
+
+        if(x + w > _c.width || y + h > _c.height)
+        {
+                NFT_LOG(L_ERROR,
+                        "Capture rectangle %dx%d at %d/%d exceeds stream (%dx%d)",
+                        w, h, x, y, _c.width, _c.height);
+                return NFT_FAILURE;
+        }
+
+        /* play back files frame by frame, drain pipes */
+        int n;
+        if((n = _read(_c.regular ? 1 : 0)) < 0)
+                return NFT_FAILURE;
+
+        /* first frame: wait for producer */
+        while(!_c.valid && !_c.eof)
+        {
+                if(!_wait() || (n = _read(0)) < 0)
+                        return NFT_FAILURE;
+        }
+
+        /* stream ended & last complete frame was already used */
+        if(_c.eof && n == 0)
+        {
+                NFT_LOG(L_INFO, "End of stream");
+                return NFT_FAILURE;
+        }
+
+        /* copy capture rectangle */
+        size_t stride = _c.width * _c.bpp;
+        size_t line = w * _c.bpp;
+        uint8_t *src = _c.latest + y * stride + x * _c.bpp;
+        uint8_t *dst = led_frame_get_buffer(frame);
+
+        if(line == stride)
+        {
+                memcpy(dst, src, h * line);
+                return NFT_SUCCESS;
+        }
+
+        LedFrameCord i;
+        for(i = 0; i < h; i++)
+        {
+                memcpy(dst, src, line);
+                dst += line;
+                src += stride;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/** return pixel-format of stream */
+static const char *_format()
+{
+        return _c.format;
+}
+
+
+/** return byte-order of stream */
+static bool _is_big_endian()
+{
+        return _c.big_endian;
+}
+
+
+/** descriptor of pipe mechanism */
+CaptureMechanism PIPE = {
+        .name = "pipe",
+        .option = _option,
+        .init = _init,
+        .deinit = _deinit,
+        .capture = _capture,
+        .format = _format,
+        .is_big_endian = _is_big_endian,
+};
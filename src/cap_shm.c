@@ -0,0 +1,209 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * capture frames from a shared-memory frame ring another process
+ * publishes to (see shmring.h for the producer protocol).
+ *
+ * The capture rectangle is copied out of the newest complete slot into
+ * a scratch buffer first and only makes it into the frame when the slot
+ * wasn't overwritten meanwhile, so frames are never torn. Frames stay
+ * black until the producer published its first one. Capturing fails when the
+ * producer removes the ring, which ends the main-loop.
+ *
+ * Options:
+ *   name=<name>   name of shared-memory object (default: "/ledcap")
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <niftyled.h>
+#include "capture.h"
+#include "shmring.h"
+#include "cap_shm.h"
+
+
+
+/** private structure to hold info accros function-calls */
+static struct
+{
+        /** name of shared-memory object */
+        char name[256];
+        /** mapped ring */
+        ShmRing *ring;
+        /** pixel-format of ring */
+        char format[32];
+        /** copy of capture rectangle while it's validated */
+        uint8_t *scratch;
+        /** size of scratch buffer */
+        size_t scratch_size;
+} _c = {
+        .name = "/ledcap",
+};
+
+
+
+
+/** set option */
+static NftResult _option(const char *key, const char *value)
+{
+        if(strcmp(key, "name") == 0)
+        {
+                if(strlen(value) >= sizeof(_c.name))
+                {
+                        NFT_LOG(L_ERROR, "Name \"%s\" too long", value);
+                        return NFT_FAILURE;
+                }
+                strcpy(_c.name, value);
+        }
+        else
+        {
+                NFT_LOG(L_ERROR, "Unknown option \"%s\"", key);
+                return NFT_FAILURE;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/** initialize this capture mechanism */
+static NftResult _init()
+{
+        if(!(_c.ring = shmring_open(_c.name)))
+                return NFT_FAILURE;
+
+        /* producer may go away, keep our own copy */
+        memcpy(_c.format, shmring_header(_c.ring)->format, sizeof(_c.format));
+
+        return NFT_SUCCESS;
+}
+
+
+/** deinitialize this capture mechanism */
+static void _deinit()
+{
+        shmring_close(_c.ring);
+        _c.ring = NULL;
+
+        free(_c.scratch);
+        _c.scratch = NULL;
+        _c.scratch_size = 0;
+}
+
+
+/** copy newest frame of ring into frame */
+static NftResult _capture(LedFrame * frame, LedFrameCord x, LedFrameCord y)
+{
+        if(!frame)
+                NFT_LOG_NULL(NFT_FAILURE);
+
+        LedFrameCord w, h;
+        if(!led_frame_get_dim(frame, &w, &h))
+                return NFT_FAILURE;
+
+        if(!shmring_alive(_c.ring))
+        {
+                NFT_LOG(L_INFO, "Producer of \"%s\" went away", _c.name);
+                return NFT_FAILURE;
+        }
+
+        size_t size = led_frame_get_buffersize(frame);
+        if(size > _c.scratch_size)
+        {
+                uint8_t *scratch;
+                if(!(scratch = realloc(_c.scratch, size)))
+                {
+                        NFT_LOG_PERROR("realloc()");
+                        return NFT_FAILURE;
+                }
+                _c.scratch = scratch;
+                _c.scratch_size = size;
+        }
+
+        uint64_t seq;
+        if(!shmring_read(_c.ring, _c.scratch, x, y, w, h, &seq))
+        {
+                /* rectangle doesn't fit, that won't change */
+                if(x + w > (LedFrameCord) shmring_header(_c.ring)->width ||
+                   y + h > (LedFrameCord) shmring_header(_c.ring)->height)
+                        return NFT_FAILURE;
+
+                /* producer too fast, keep previous frame */
+                return NFT_SUCCESS;
+        }
+
+        /* nothing published, yet */
+        if(seq == 0)
+                memset(led_frame_get_buffer(frame), 0, size);
+        else
+                memcpy(led_frame_get_buffer(frame), _c.scratch, size);
+
+        return NFT_SUCCESS;
+}
+
+
+/** return pixel-format of ring */
+static const char *_format()
+{
+        return _c.format;
+}
+
+
+/** return byte-order of ring */
+static bool _is_big_endian()
+{
+        return _c.ring && shmring_header(_c.ring)->big_endian;
+}
+
+
+/** descriptor of shared-memory ring mechanism */
+CaptureMechanism SHM = {
+        .name = "shm",
+        .option = _option,
+        .init = _init,
+        .deinit = _deinit,
+        .capture = _capture,
+        .format = _format,
+        .is_big_endian = _is_big_endian,
+};
@@ -45,12 +45,89 @@
 
 #ifdef HAVE_X
 
+#include <stdlib.h>
+#include <pthread.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#ifdef HAVE_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif /* HAVE_XSHM */
+#include <stdint.h>
 #include <niftyled.h>
 #include "capture.h"
+#include "convert.h"
+#include "cap_x11.h"
 
-#define X_LOG_ERR(code) {  NFT_LOG(L_ERROR, "%s", _xerr); };
+
+/** how pixels of the default visual are laid out in an XImage */
+typedef enum
+{
+        /** 32 bit, 8 bits per component (delivered as is) */
+        LAYOUT_XRGB32,
+        /** 24 bit packed, 8 bits per component */
+        LAYOUT_RGB24,
+        /** 16 bit 5:6:5 in host byte-order */
+        LAYOUT_RGB565,
+        /** 32 bit 2:10:10:10 in host byte-order (deep color) */
+        LAYOUT_X2RGB10,
+        /** any other TrueColor visual (slow, pixel by pixel) */
+        LAYOUT_GENERIC,
+} Layout;
+
+
+/** how pixels of a visual are stored & delivered */
+typedef struct
+{
+        /** pixel layout of visual */
+        Layout layout;
+        /** format of frames we deliver */
+        const char *format;
+        /** conversion of every row (CONVERT_NONE = copy) */
+        ConvertKernel convert;
+        /** bytes per pixel of frames we deliver */
+        size_t bpp;
+        /** masks of visual (LAYOUT_GENERIC) */
+        unsigned long mask[3];
+} Pixels;
+
+
+/** maximum amount of bands a frame can be captured in */
+#define TILES_MAX 16
+/** connections X errors are tracked for (tiles & other displays) */
+#define CONNECTIONS_MAX (TILES_MAX + 16)
+
+
+/** horizontal band of the frame, captured over its own connection */
+typedef struct
+{
+        /** connection of this band (the main one for the first band) */
+        Display *display;
+        /** worker thread (not used for first band) */
+        pthread_t thread;
+        /** first row of band in frame */
+        LedFrameCord y;
+        /** amount of rows */
+        LedFrameCord h;
+        /** result of last capture */
+        NftResult result;
+#ifdef HAVE_XSHM
+        /** persistent image of band living in shared memory */
+        XImage *image;
+        /** shared memory segment backing image */
+        XShmSegmentInfo shminfo;
+#endif /* HAVE_XSHM */
+} Tile;
+
+
+/** last X error of one connection */
+typedef struct
+{
+        Display *display;
+        /** X error code (0 = none) */
+        int error;
+} ConnError;
 
 
 /** private structure to hold info accros function-calls */
@@ -58,22 +135,200 @@ static struct
 {
         Display *display;
         int screen;
-} _c;
+        /** last X error of every connection (set by _err_handler) */
+        ConnError errors[CONNECTIONS_MAX];
+        /** last X error of connections that didn't fit into errors */
+        int error;
+        /** protects errors */
+        pthread_mutex_t errors_lock;
+        /** XImage wrapping the buffer of the last frame for region capture */
+        XImage *fimage;
+        /** how we get pixels of default visual */
+        Pixels px;
+#ifdef HAVE_XSHM
+        /** persistent image living in shared memory */
+        XImage *image;
+        /** shared memory segment backing image */
+        XShmSegmentInfo shminfo;
+#endif /* HAVE_XSHM */
+        /** capture via MIT-SHM */
+        bool shm;
+        /** amount of bands (1 = not tiled) */
+        int tiles;
+        /** bands of frame */
+        Tile tile[TILES_MAX];
+        /** amount of worker threads running */
+        int workers;
+        /** dimensions of frame bands are laid out for */
+        LedFrameCord tw, th;
+        /** protects everything below */
+        pthread_mutex_t lock;
+        /** signalled when a capture is started or workers should quit */
+        pthread_cond_t start;
+        /** signalled when the last worker finished its band */
+        pthread_cond_t done;
+        /** incremented for every capture */
+        unsigned long generation;
+        /** amount of workers that didn't finish their band yet */
+        int pending;
+        /** true if workers should exit */
+        bool quit;
+        /** frame & position of current capture */
+        LedFrame *frame;
+        LedFrameCord x, y;
+} _c = {
+        .tiles = 1,
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .errors_lock = PTHREAD_MUTEX_INITIALIZER,
+        .start = PTHREAD_COND_INITIALIZER,
+        .done = PTHREAD_COND_INITIALIZER,
+};
+
+
+static NftResult _tiles_capture(LedFrame * frame, LedFrameCord x,
+                                LedFrameCord y);
+
+
+
+
+/**
+ * get last X error of connection. The error handler is process-wide and
+ * connections are used by different threads, so errors are kept per
+ * connection to not pick up (or clear) those of another one
+ */
+static int *_error(Display * d)
+{
+        int *error = &_c.error;
+
+        pthread_mutex_lock(&_c.errors_lock);
+
+        int i, unused = -1;
+        for(i = 0; i < CONNECTIONS_MAX; i++)
+        {
+                if(_c.errors[i].display == d)
+                        break;
+                if(!_c.errors[i].display && unused < 0)
+                        unused = i;
+        }
+
+        if(i == CONNECTIONS_MAX && unused >= 0)
+        {
+                i = unused;
+                _c.errors[i].display = d;
+                _c.errors[i].error = 0;
+        }
+
+        if(i < CONNECTIONS_MAX)
+                error = &_c.errors[i].error;
+
+        pthread_mutex_unlock(&_c.errors_lock);
+
+        return error;
+}
+
+
+/** close connection & forget its errors */
+static void _close(Display * d)
+{
+        pthread_mutex_lock(&_c.errors_lock);
+
+        int i;
+        for(i = 0; i < CONNECTIONS_MAX; i++)
+        {
+                if(_c.errors[i].display == d)
+                        _c.errors[i].display = NULL;
+        }
 
+        pthread_mutex_unlock(&_c.errors_lock);
 
+        XCloseDisplay(d);
+}
 
 
-/** X11 Error handler, displays error message */
+/** X11 Error handler, remembers error of connection */
 static int _err_handler(Display * d, XErrorEvent * err)
 {
-        /** space for X error message */
-        static char _xerr[1024];
+        char msg[256];
+        XGetErrorText(d, err->error_code, msg, sizeof(msg));
+        NFT_LOG(L_DEBUG, "X error: %s", msg);
 
-        XGetErrorText(d, err->error_code, _xerr, sizeof(_xerr));
+        *_error(d) = err->error_code;
         return 0;
 }
 
 
+/** position of lowest & amount of set bits in mask */
+static void _mask_bits(unsigned long mask, int *shift, int *bits)
+{
+        *shift = mask ? __builtin_ctzl(mask) : 0;
+        *bits = __builtin_popcountl(mask);
+}
+
+
+/**
+ * convert row of any TrueColor image to R,G,B u8
+ */
+static void _row_generic(const Pixels * px, uint8_t * dst, XImage * image,
+                         LedFrameCord y, LedFrameCord w)
+{
+        int shift[3], bits[3], c;
+        for(c = 0; c < 3; c++)
+                _mask_bits(px->mask[c], &shift[c], &bits[c]);
+
+        LedFrameCord x;
+        for(x = 0; x < w; x++, dst += 3)
+        {
+                unsigned long p = XGetPixel(image, x, y);
+                for(c = 0; c < 3; c++)
+                {
+                        unsigned long v = (p & px->mask[c]) >> shift[c];
+                        dst[c] = bits[c] >= 8 ? v >> (bits[c] - 8) :
+                                (bits[c] ? v * 255 / ((1ul << bits[c]) - 1) :
+                                 0);
+                }
+        }
+}
+
+
+/**
+ * store w x h pixels of image (starting at its origin) at x/y of frame,
+ * honoring scanline padding & converting to the format we deliver
+ */
+static void _store(const Pixels * px, LedFrame * frame, XImage * image,
+                   LedFrameCord x, LedFrameCord y, LedFrameCord w,
+                   LedFrameCord h)
+{
+        LedFrameCord fw, fh;
+        led_frame_get_dim(frame, &fw, &fh);
+
+        size_t stride = (size_t) fw * px->bpp;
+        uint8_t *dst = (uint8_t *) led_frame_get_buffer(frame) +
+                y * stride + x * px->bpp;
+
+        /* whole frame in one go */
+        if(px->layout != LAYOUT_GENERIC && !px->convert && x == 0 && w == fw &&
+           (size_t) image->bytes_per_line == stride)
+        {
+                memcpy(dst, image->data, stride * h);
+                return;
+        }
+
+        LedFrameCord row;
+        for(row = 0; row < h; row++, dst += stride)
+        {
+                const uint8_t *src = (const uint8_t *) image->data +
+                        row * image->bytes_per_line;
+
+                if(px->layout == LAYOUT_GENERIC)
+                        _row_generic(px, dst, image, row, w);
+                else if(px->convert)
+                        convert_run(px->convert, dst, src, w);
+                else
+                        memcpy(dst, src, w * px->bpp);
+        }
+}
+
+
 /**
  * capture image
  */
@@ -82,11 +337,15 @@ static NftResult _capture(LedFrame * frame, LedFrameCord x, LedFrameCord y)
         if(!frame)
                 NFT_LOG_NULL(NFT_FAILURE);
 
-		/* get frame dimensions */
-		LedFrameCord w, h;
-		if(!led_frame_get_dim(frame, &w, &h))
-				return NFT_FAILURE;
-		
+        /* capture bands in parallel */
+        if(_c.tiles > 1)
+                return _tiles_capture(frame, x, y);
+
+        /* get frame dimensions */
+        LedFrameCord w, h;
+        if(!led_frame_get_dim(frame, &w, &h))
+                return NFT_FAILURE;
+
         /* get screen-portion from X server */
         XImage *image = NULL;
         if(!(image = XGetImage(_c.display, RootWindow(_c.display, _c.screen),
@@ -98,8 +357,7 @@ static NftResult _capture(LedFrame * frame, LedFrameCord x, LedFrameCord y)
         }
 
         /* copy framebuffer */
-        memcpy(led_frame_get_buffer(frame), image->data,
-               led_frame_get_buffersize(frame));
+        _store(&_c.px, frame, image, 0, 0, w, h);
 
         /* destroy images */
         XDestroyImage(image);
@@ -109,120 +367,604 @@ static NftResult _capture(LedFrame * frame, LedFrameCord x, LedFrameCord y)
 
 
 /**
- * initialize capture mechanism
+ * destroy XImage wrapping a frame buffer (but not the buffer itself)
  */
-static NftResult _init()
+static void _frame_image_destroy()
 {
-        /* connect to display */
-        if(!(_c.display = XOpenDisplay(NULL)))
+        if(!_c.fimage)
+                return;
+
+        _c.fimage->data = NULL;
+        XDestroyImage(_c.fimage);
+        _c.fimage = NULL;
+}
+
+
+/**
+ * get XImage that uses the buffer of frame as data
+ */
+static XImage *_frame_image(LedFrame * frame, LedFrameCord w, LedFrameCord h)
+{
+        char *buffer = led_frame_get_buffer(frame);
+
+        /* reuse image if frame didn't change */
+        if(_c.fimage && _c.fimage->data == buffer &&
+           _c.fimage->width == w && _c.fimage->height == h)
+                return _c.fimage;
+
+        _frame_image_destroy();
+
+        size_t bpp =
+                led_pixel_format_get_bytes_per_pixel(led_frame_get_format
+                                                     (frame));
+        if(!(_c.fimage = XCreateImage(_c.display,
+                                      DefaultVisual(_c.display, _c.screen),
+                                      DefaultDepth(_c.display, _c.screen),
+                                      ZPixmap, 0, buffer, w, h, 32, w * bpp)))
+        {
+                NFT_LOG(L_ERROR, "XCreateImage() failed");
+                return NULL;
+        }
+
+        /* we can only write to frame if pixel sizes match */
+        if((size_t) _c.fimage->bits_per_pixel != bpp * 8)
+        {
+                NFT_LOG(L_ERROR,
+                        "Frame has %zu bits per pixel, X server delivers %d",
+                        bpp * 8, _c.fimage->bits_per_pixel);
+                _frame_image_destroy();
+                return NULL;
+        }
+
+        return _c.fimage;
+}
+
+
+/**
+ * capture rectangle r of image into the same position of frame
+ */
+static NftResult _capture_region(LedFrame * frame, LedFrameCord x,
+                                 LedFrameCord y, CaptureRect * r)
+{
+        if(!frame || !r)
+                NFT_LOG_NULL(NFT_FAILURE);
+
+        /* get frame dimensions */
+        LedFrameCord w, h;
+        if(!led_frame_get_dim(frame, &w, &h))
                 return NFT_FAILURE;
 
-        /* get screen */
-        _c.screen = DefaultScreen(_c.display);
+        /* frame has another format than the X server delivers */
+        if(_c.px.layout != LAYOUT_XRGB32)
+        {
+                XImage *image;
+                if(!(image = XGetImage(_c.display,
+                                       RootWindow(_c.display, _c.screen),
+                                       x + r->x, y + r->y, r->w, r->h,
+                                       AllPlanes, ZPixmap)))
+                {
+                        NFT_LOG(L_ERROR, "XGetImage() failed");
+                        return NFT_FAILURE;
+                }
 
-        /* set X error handler */
-        XSetErrorHandler(_err_handler);
+                _store(&_c.px, frame, image, r->x, r->y, r->w, r->h);
+                XDestroyImage(image);
+                return NFT_SUCCESS;
+        }
+
+        XImage *image;
+        if(!(image = _frame_image(frame, w, h)))
+                return NFT_FAILURE;
+
+        /* let Xlib write the screen-portion directly into our frame */
+        if(!XGetSubImage(_c.display, RootWindow(_c.display, _c.screen),
+                         x + r->x, y + r->y, r->w, r->h, AllPlanes, ZPixmap,
+                         image, r->x, r->y))
+        {
+                NFT_LOG(L_ERROR, "XGetSubImage() failed");
+                return NFT_FAILURE;
+        }
 
         return NFT_SUCCESS;
 }
 
 
 /**
- * deinitialize capture mechanism
+ * find out how pixels of the default visual of screen are laid out & how
+ * we deliver them
  */
-static void _deinit()
+static NftResult _layout(Display * d, int screen, Pixels * px)
 {
-        /* close connection to display */
-        if(_c.display)
-                XCloseDisplay(_c.display);
+        Visual *v = DefaultVisual(d, screen);
+        int depth = DefaultDepth(d, screen);
+
+        if(v->class != TrueColor && v->class != DirectColor)
+        {
+                NFT_LOG(L_ERROR, "Only TrueColor visuals are supported");
+                return NFT_FAILURE;
+        }
+
+        /* bits per pixel of images with default depth */
+        int i, n, bpp = 0;
+        XPixmapFormatValues *pf = XListPixmapFormats(d, &n);
+        for(i = 0; pf && i < n; i++)
+        {
+                if(pf[i].depth == depth)
+                        bpp = pf[i].bits_per_pixel;
+        }
+        XFree(pf);
+
+        px->mask[0] = v->red_mask;
+        px->mask[1] = v->green_mask;
+        px->mask[2] = v->blue_mask;
+
+        /* fast paths need pixels in host byte-order (except 8 bit ones) */
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        bool native = XImageByteOrder(d) == LSBFirst;
+#else
+        bool native = XImageByteOrder(d) == MSBFirst;
+#endif
+        bool rgb888 = v->red_mask == 0xff0000 && v->green_mask == 0xff00 &&
+                v->blue_mask == 0xff;
+
+        if(bpp == 32 && rgb888)
+        {
+                px->layout = LAYOUT_XRGB32;
+                px->format = "ARGB u8";
+                px->convert = CONVERT_NONE;
+                px->bpp = 4;
+        }
+        else if(bpp == 24 && rgb888)
+        {
+                px->layout = LAYOUT_RGB24;
+                px->format = "RGB u8";
+                px->convert = XImageByteOrder(d) == LSBFirst ?
+                        CONVERT_BGR_RGB : CONVERT_NONE;
+                px->bpp = 3;
+        }
+        else if(bpp == 16 && native && v->red_mask == 0xf800 &&
+                v->green_mask == 0x7e0 && v->blue_mask == 0x1f)
+        {
+                px->layout = LAYOUT_RGB565;
+                px->format = "RGB u8";
+                px->convert = CONVERT_RGB565_RGB;
+                px->bpp = 3;
+        }
+        else if(bpp == 32 && native && v->red_mask == 0x3ff00000 &&
+                v->green_mask == 0xffc00 && v->blue_mask == 0x3ff)
+        {
+                px->layout = LAYOUT_X2RGB10;
+                px->format = "RGB u16";
+                px->convert = CONVERT_X2RGB10_RGB16;
+                px->bpp = 6;
+        }
+        else
+        {
+                px->layout = LAYOUT_GENERIC;
+                px->format = "RGB u8";
+                px->convert = CONVERT_NONE;
+                px->bpp = 3;
+        }
+
+        /* make sure kernels are selected */
+        if(px->convert)
+                convert_init();
+
+        NFT_LOG(L_VERBOSE, "Depth: %d, %d bits per pixel, Red-mask: 0x%lx "
+                "Green-mask: 0x%lx Blue-mask: 0x%lx, delivering %s%s",
+                depth, bpp, v->red_mask, v->green_mask, v->blue_mask,
+                px->format,
+                px->layout == LAYOUT_GENERIC ? " (slow path)" : "");
+
+        return NFT_SUCCESS;
 }
 
+
+#ifdef HAVE_XSHM
+
 /**
- * return prefered frame format (if this is 100% correct, I eat my shorts ;)
+ * destroy shared-memory image (if any)
  */
-static const char *_format()
+static void _shm_image_destroy(Display * d, XImage ** image,
+                               XShmSegmentInfo * info)
 {
-        if(!_c.display)
-                NFT_LOG_NULL(NULL);
+        if(!*image)
+                return;
+
+        XShmDetach(d, info);
+        XDestroyImage(*image);
+        shmdt(info->shmaddr);
+        *image = NULL;
+}
 
-        /* our result */
-        char *res = "error";
 
-        /* get XVisualInfo */
-        XVisualInfo vi_proto = {.screen = _c.screen };
-        XVisualInfo *vi;
-        int nvi = 0;
-        vi = XGetVisualInfo(_c.display, VisualScreenMask, &vi_proto, &nvi);
-        if(!nvi)
+/**
+ * create shared-memory image of w x h pixels
+ */
+static NftResult _shm_image_create(Display * d, XImage ** image,
+                                   XShmSegmentInfo * info, LedFrameCord w,
+                                   LedFrameCord h)
+{
+        if(!(*image = XShmCreateImage(d, DefaultVisual(d, DefaultScreen(d)),
+                                      DefaultDepth(d, DefaultScreen(d)),
+                                      ZPixmap, NULL, info, w, h)))
         {
-                NFT_LOG(L_ERROR, "No VisualInfo's returned?!");
-                return NULL;
+                NFT_LOG(L_ERROR, "XShmCreateImage() failed");
+                return NFT_FAILURE;
         }
 
-        /* get default visual id */
-        VisualID id;
-        id = XVisualIDFromVisual(DefaultVisual(_c.display, _c.screen));
+        /* allocate segment */
+        if((info->shmid = shmget(IPC_PRIVATE,
+                                 (*image)->bytes_per_line * (*image)->height,
+                                 IPC_CREAT | 0600)) < 0)
+        {
+                NFT_LOG_PERROR("shmget()");
+                goto _sic_error;
+        }
 
-        /* get our VisualInfo */
-        XVisualInfo *myvi = NULL;
-        int i;
-        for(i = 0; i < nvi; i++)
+        if((info->shmaddr = shmat(info->shmid, NULL, 0)) == (void *) -1)
         {
-                if((vi[i].visualid) == id)
-                {
-                        myvi = &vi[i];
-                        break;
-                }
+                NFT_LOG_PERROR("shmat()");
+                shmctl(info->shmid, IPC_RMID, NULL);
+                goto _sic_error;
         }
+        (*image)->data = info->shmaddr;
+        info->readOnly = False;
+
+        /* let X server attach segment */
+        int *error = _error(d);
+        *error = 0;
+        XShmAttach(d, info);
+        XSync(d, False);
 
-        /* this may not happen */
-        if(!myvi)
+        /* segment is destroyed as soon as both sides detached */
+        shmctl(info->shmid, IPC_RMID, NULL);
+
+        if(*error)
         {
-                NFT_LOG(L_ERROR, "Didn't find our VisualID?!");
-                goto _f_exit;
+                NFT_LOG(L_ERROR,
+                        "XShmAttach() failed. (Not a local X server?)");
+                shmdt(info->shmaddr);
+                goto _sic_error;
         }
 
+        NFT_LOG(L_VERBOSE, "Created %dx%d shared-memory image (%d bytes/line)",
+                w, h, (*image)->bytes_per_line);
 
-        /* decide about bits-per-component */
-        switch (myvi->bits_per_rgb)
+        return NFT_SUCCESS;
+
+_sic_error:
+        XDestroyImage(*image);
+        *image = NULL;
+        return NFT_FAILURE;
+}
+
+
+#endif /* HAVE_XSHM */
+
+
+/**
+ * set option
+ */
+static NftResult _option(const char *key, const char *value)
+{
+        if(strcmp(key, "tiles") == 0)
         {
-                case 8:
+                int n = atoi(value);
+                if(n < 1 || n > TILES_MAX)
                 {
-                        res = "ARGB u8";
-                        break;
+                        NFT_LOG(L_ERROR, "Invalid amount of tiles: %s "
+                                "(1-%d)", value, TILES_MAX);
+                        return NFT_FAILURE;
                 }
+                _c.tiles = n;
+        }
+        else
+        {
+                NFT_LOG(L_ERROR, "Unknown option \"%s\"", key);
+                return NFT_FAILURE;
+        }
 
-                case 16:
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * capture band of current frame over connection of tile
+ */
+static NftResult _tile_capture(Tile * t)
+{
+        if(!t->h)
+                return NFT_SUCCESS;
+
+        Window root = RootWindow(t->display, _c.screen);
+
+#ifdef HAVE_XSHM
+        if(_c.shm)
+        {
+                if(!XShmGetImage(t->display, root, t->image, _c.x,
+                                 _c.y + t->y, AllPlanes))
                 {
-                        res = "ARGB u16";
+                        NFT_LOG(L_ERROR, "XShmGetImage() failed");
+                        return NFT_FAILURE;
+                }
+
+                _store(&_c.px, _c.frame, t->image, 0, t->y, _c.tw, t->h);
+                return NFT_SUCCESS;
+        }
+#endif /* HAVE_XSHM */
+
+        XImage *image;
+        if(!(image = XGetImage(t->display, root, _c.x, _c.y + t->y, _c.tw,
+                               t->h, AllPlanes, ZPixmap)))
+        {
+                NFT_LOG(L_ERROR, "XGetImage() failed");
+                return NFT_FAILURE;
+        }
+
+        _store(&_c.px, _c.frame, image, 0, t->y, _c.tw, t->h);
+        XDestroyImage(image);
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * worker capturing one band whenever a capture is started
+ */
+static void *_tile_thread(void *arg)
+{
+        Tile *t = arg;
+        unsigned long generation = 0;
+
+        pthread_mutex_lock(&_c.lock);
+        while(true)
+        {
+                while(!_c.quit && _c.generation == generation)
+                        pthread_cond_wait(&_c.start, &_c.lock);
+
+                if(_c.quit)
                         break;
+
+                generation = _c.generation;
+                pthread_mutex_unlock(&_c.lock);
+
+                t->result = _tile_capture(t);
+
+                pthread_mutex_lock(&_c.lock);
+                if(--_c.pending == 0)
+                        pthread_cond_signal(&_c.done);
+        }
+        pthread_mutex_unlock(&_c.lock);
+
+        return NULL;
+}
+
+
+/**
+ * split frame of w x h pixels in bands (only called while workers idle)
+ */
+static NftResult _tiles_layout(LedFrameCord w, LedFrameCord h)
+{
+        int i;
+        for(i = 0; i < _c.tiles; i++)
+        {
+                Tile *t = &_c.tile[i];
+                t->y = (LedFrameCord) ((long long) h * i / _c.tiles);
+                t->h = (LedFrameCord) ((long long) h * (i + 1) / _c.tiles) -
+                        t->y;
+
+#ifdef HAVE_XSHM
+                if(!_c.shm)
+                        continue;
+
+                _shm_image_destroy(t->display, &t->image, &t->shminfo);
+                if(t->h && !_shm_image_create(t->display, &t->image,
+                                              &t->shminfo, w, t->h))
+                {
+                        _c.tw = _c.th = 0;
+                        return NFT_FAILURE;
                 }
+#endif /* HAVE_XSHM */
+        }
+
+        _c.tw = w;
+        _c.th = h;
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * capture frame in bands, first band in this thread, the others by workers
+ */
+static NftResult _tiles_capture(LedFrame * frame, LedFrameCord x,
+                                LedFrameCord y)
+{
+        LedFrameCord w, h;
+        if(!led_frame_get_dim(frame, &w, &h))
+                return NFT_FAILURE;
+
+        if((w != _c.tw || h != _c.th) && !_tiles_layout(w, h))
+                return NFT_FAILURE;
+
+        /* start workers */
+        pthread_mutex_lock(&_c.lock);
+        _c.frame = frame;
+        _c.x = x;
+        _c.y = y;
+        _c.pending = _c.workers;
+        _c.generation++;
+        pthread_cond_broadcast(&_c.start);
+        pthread_mutex_unlock(&_c.lock);
+
+        NftResult res = _tile_capture(&_c.tile[0]);
 
-                case 32:
+        /* wait for workers */
+        pthread_mutex_lock(&_c.lock);
+        while(_c.pending)
+                pthread_cond_wait(&_c.done, &_c.lock);
+        pthread_mutex_unlock(&_c.lock);
+
+        int i;
+        for(i = 1; i < _c.tiles; i++)
+        {
+                if(!_c.tile[i].result)
+                        res = NFT_FAILURE;
+        }
+
+        return res;
+}
+
+
+/**
+ * stop workers & close their connections
+ */
+static void _tiles_deinit()
+{
+        pthread_mutex_lock(&_c.lock);
+        _c.quit = true;
+        pthread_cond_broadcast(&_c.start);
+        pthread_mutex_unlock(&_c.lock);
+
+        int i;
+        for(i = 1; i <= _c.workers; i++)
+                pthread_join(_c.tile[i].thread, NULL);
+        _c.workers = 0;
+        _c.quit = false;
+
+        for(i = 0; i < _c.tiles; i++)
+        {
+                Tile *t = &_c.tile[i];
+                if(!t->display)
+                        continue;
+
+#ifdef HAVE_XSHM
+                _shm_image_destroy(t->display, &t->image, &t->shminfo);
+#endif /* HAVE_XSHM */
+
+                /* first band uses main connection */
+                if(i > 0)
+                        _close(t->display);
+                t->display = NULL;
+        }
+
+        _c.tw = _c.th = 0;
+}
+
+
+/**
+ * open connections & start workers for tiled capture
+ */
+static NftResult _tiles_init()
+{
+        if(_c.tiles < 2)
+                return NFT_SUCCESS;
+
+        _c.tile[0].display = _c.display;
+
+        int i;
+        for(i = 1; i < _c.tiles; i++)
+        {
+                Tile *t = &_c.tile[i];
+                if(!(t->display = XOpenDisplay(NULL)))
                 {
-                        res = "ARGB u32";
-                        break;
+                        NFT_LOG(L_ERROR, "Failed to open connection %d", i);
+                        return NFT_FAILURE;
                 }
 
-                default:
+                if(pthread_create(&t->thread, NULL, _tile_thread, t) != 0)
                 {
-                        NFT_LOG(L_ERROR, "Invalid bits-per-component: %d",
-                                myvi->bits_per_rgb);
-                        return NULL;
+                        NFT_LOG_PERROR("pthread_create()");
+                        return NFT_FAILURE;
                 }
+                _c.workers++;
+        }
+
+        NFT_LOG(L_INFO, "Capturing in %d bands over %d connections",
+                _c.tiles, _c.tiles);
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * connect to display & find out how we get pixels
+ */
+static NftResult _open()
+{
+        /* every band is captured by its own thread */
+        if(_c.tiles > 1 && !XInitThreads())
+        {
+                NFT_LOG(L_ERROR, "XInitThreads() failed");
+                return NFT_FAILURE;
+        }
+
+        /* connect to display */
+        if(!(_c.display = XOpenDisplay(NULL)))
+                return NFT_FAILURE;
+
+        /* get screen */
+        _c.screen = DefaultScreen(_c.display);
+
+        /* set X error handler */
+        XSetErrorHandler(_err_handler);
+
+        /* find out how we get pixels */
+        if(!_layout(_c.display, _c.screen, &_c.px))
+        {
+                _close(_c.display);
+                _c.display = NULL;
+                return NFT_FAILURE;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * deinitialize capture mechanism
+ */
+static void _deinit()
+{
+        _tiles_deinit();
+        _frame_image_destroy();
+
+        /* close connection to display */
+        if(_c.display)
+                _close(_c.display);
+        _c.display = NULL;
+        _c.shm = false;
+}
+
 
+/**
+ * initialize capture mechanism
+ */
+static NftResult _init()
+{
+        if(!_open())
+                return NFT_FAILURE;
+
+        if(!_tiles_init())
+        {
+                _deinit();
+                return NFT_FAILURE;
         }
 
+        return NFT_SUCCESS;
+}
 
-_f_exit:
-        NFT_LOG(L_VERBOSE, "Depth: %d Red-mask: 0x%lx Green-mask: "
-                "0x%lx Blue-mask: 0x%lx Bits per component: %d",
-                myvi->depth,
-                myvi->red_mask,
-                myvi->green_mask, myvi->blue_mask, myvi->bits_per_rgb);
-        XFree(vi);
 
-        return (const char *) res;
+/**
+ * return prefered frame format
+ */
+static const char *_format()
+{
+        if(!_c.display)
+                NFT_LOG_NULL(NULL);
+
+        return _c.px.format;
 }
 
 
@@ -231,21 +973,334 @@ _f_exit:
  */
 static bool _is_big_endian()
 {
+        /* converted pixels are always stored in order of the format */
+        if(_c.px.layout != LAYOUT_XRGB32)
+                return false;
+
         if(XImageByteOrder(_c.display) == LSBFirst)
                 return true;
         else
                 return false;
 }
 
+#ifdef HAVE_XSHM
+
+/**
+ * capture image using MIT-SHM
+ */
+static NftResult _shm_capture(LedFrame * frame, LedFrameCord x,
+                              LedFrameCord y)
+{
+        if(!frame)
+                NFT_LOG_NULL(NFT_FAILURE);
+
+        /* capture bands in parallel */
+        if(_c.tiles > 1)
+                return _tiles_capture(frame, x, y);
+
+        /* get frame dimensions */
+        LedFrameCord w, h;
+        if(!led_frame_get_dim(frame, &w, &h))
+                return NFT_FAILURE;
+
+        /* (re-)create image when frame dimensions changed */
+        if(_c.image && (_c.image->width != w || _c.image->height != h))
+                _shm_image_destroy(_c.display, &_c.image, &_c.shminfo);
+
+        if(!_c.image &&
+           !_shm_image_create(_c.display, &_c.image, &_c.shminfo, w, h))
+                return NFT_FAILURE;
+
+        /* let X server write screen-portion to our segment */
+        if(!XShmGetImage(_c.display, RootWindow(_c.display, _c.screen),
+                         _c.image, x, y, AllPlanes))
+        {
+                NFT_LOG(L_ERROR, "XShmGetImage() failed");
+                return NFT_FAILURE;
+        }
+
+        /* copy to framebuffer (row by row if scanlines are padded) */
+        _store(&_c.px, frame, _c.image, 0, 0, w, h);
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * capture rectangle r of image into the same position of frame using MIT-SHM
+ */
+static NftResult _shm_capture_region(LedFrame * frame, LedFrameCord x,
+                                     LedFrameCord y, CaptureRect * r)
+{
+        if(!frame || !r)
+                NFT_LOG_NULL(NFT_FAILURE);
+
+        /* get frame dimensions */
+        LedFrameCord w, h;
+        if(!led_frame_get_dim(frame, &w, &h))
+                return NFT_FAILURE;
+
+        if(_c.image && (_c.image->width != w || _c.image->height != h))
+                _shm_image_destroy(_c.display, &_c.image, &_c.shminfo);
+
+        if(!_c.image &&
+           !_shm_image_create(_c.display, &_c.image, &_c.shminfo, w, h))
+                return NFT_FAILURE;
+
+        /* the segment is large enough for any rectangle inside the frame,
+           so let the X server fill it as an image of the rectangle size */
+        XImage sub = *_c.image;
+        sub.width = r->w;
+        sub.height = r->h;
+        sub.bytes_per_line =
+                ((r->w * sub.bits_per_pixel + sub.bitmap_pad -
+                  1) / sub.bitmap_pad) * (sub.bitmap_pad / 8);
+
+        if(!XShmGetImage(_c.display, RootWindow(_c.display, _c.screen),
+                         &sub, x + r->x, y + r->y, AllPlanes))
+        {
+                NFT_LOG(L_ERROR, "XShmGetImage() failed");
+                return NFT_FAILURE;
+        }
+
+        /* copy rows to their position in framebuffer */
+        _store(&_c.px, frame, &sub, r->x, r->y, r->w, r->h);
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * deinitialize MIT-SHM capture mechanism
+ */
+static void _shm_deinit()
+{
+        _shm_image_destroy(_c.display, &_c.image, &_c.shminfo);
+        _deinit();
+}
+
+
+/**
+ * initialize MIT-SHM capture mechanism
+ */
+static NftResult _shm_init()
+{
+        if(!_open())
+                return NFT_FAILURE;
+
+        if(!XShmQueryExtension(_c.display))
+        {
+                NFT_LOG(L_ERROR, "X server doesn't support MIT-SHM extension");
+                _deinit();
+                return NFT_FAILURE;
+        }
+        _c.shm = true;
+
+        if(!_tiles_init())
+        {
+                _shm_deinit();
+                return NFT_FAILURE;
+        }
+
+        return NFT_SUCCESS;
+}
+
+#endif /* HAVE_XSHM */
+
+
+/** another X display, captured independently of the mechanism */
+struct _X11Display
+{
+        Display *display;
+        int screen;
+        /** how we get pixels of default visual */
+        Pixels px;
+#ifdef HAVE_XSHM
+        /** capture via MIT-SHM */
+        bool shm;
+        /** persistent image living in shared memory */
+        XImage *image;
+        /** shared memory segment backing image */
+        XShmSegmentInfo shminfo;
+#endif /* HAVE_XSHM */
+};
+
+
+/**
+ * close display opened by x11_display_open()
+ */
+void x11_display_close(X11Display * d)
+{
+        if(!d)
+                return;
+
+#ifdef HAVE_XSHM
+        _shm_image_destroy(d->display, &d->image, &d->shminfo);
+#endif /* HAVE_XSHM */
+
+        if(d->display)
+                _close(d->display);
+        free(d);
+}
+
+
+/**
+ * open X display to capture from another thread than the mechanism
+ * (call before anything else in this process talks to an X server)
+ *
+ * @param name display name (e.g. ":0.1")
+ */
+X11Display *x11_display_open(const char *name)
+{
+        if(!name)
+                NFT_LOG_NULL(NULL);
+
+        if(!XInitThreads())
+        {
+                NFT_LOG(L_ERROR, "XInitThreads() failed");
+                return NULL;
+        }
+
+        X11Display *d;
+        if(!(d = calloc(1, sizeof(X11Display))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+
+        if(!(d->display = XOpenDisplay(name)))
+        {
+                NFT_LOG(L_ERROR, "Can't open X display \"%s\"", name);
+                goto _do_error;
+        }
+
+        d->screen = DefaultScreen(d->display);
+        XSetErrorHandler(_err_handler);
+
+        if(!_layout(d->display, d->screen, &d->px))
+                goto _do_error;
+
+#ifdef HAVE_XSHM
+        d->shm = XShmQueryExtension(d->display);
+#endif /* HAVE_XSHM */
+
+        return d;
+
+_do_error:
+        x11_display_close(d);
+        return NULL;
+}
+
+
+/**
+ * format of frames captured from display
+ */
+const char *x11_display_format(X11Display * d)
+{
+        if(!d)
+                NFT_LOG_NULL(NULL);
+
+        return d->px.format;
+}
+
+
+/**
+ * whether frames captured from display are big-endian ordered
+ */
+bool x11_display_is_big_endian(X11Display * d)
+{
+        if(!d)
+                NFT_LOG_NULL(false);
+
+        if(d->px.layout != LAYOUT_XRGB32)
+                return false;
+
+        return XImageByteOrder(d->display) == LSBFirst;
+}
+
+
+/**
+ * capture rectangle at x/y of display into frame
+ */
+NftResult x11_display_capture(X11Display * d, LedFrame * frame,
+                              LedFrameCord x, LedFrameCord y)
+{
+        if(!d || !frame)
+                NFT_LOG_NULL(NFT_FAILURE);
+
+        LedFrameCord w, h;
+        if(!led_frame_get_dim(frame, &w, &h))
+                return NFT_FAILURE;
+
+        Window root = RootWindow(d->display, d->screen);
+
+#ifdef HAVE_XSHM
+        if(d->shm)
+        {
+                if(d->image && (d->image->width != w || d->image->height != h))
+                        _shm_image_destroy(d->display, &d->image,
+                                           &d->shminfo);
+
+                /* fall back to XGetImage() if segment can't be attached */
+                if(!d->image &&
+                   !_shm_image_create(d->display, &d->image, &d->shminfo, w,
+                                      h))
+                        d->shm = false;
+        }
+
+        if(d->shm)
+        {
+                if(!XShmGetImage(d->display, root, d->image, x, y, AllPlanes))
+                {
+                        NFT_LOG(L_ERROR, "XShmGetImage() failed");
+                        return NFT_FAILURE;
+                }
+
+                _store(&d->px, frame, d->image, 0, 0, w, h);
+                return NFT_SUCCESS;
+        }
+#endif /* HAVE_XSHM */
+
+        XImage *image;
+        if(!(image = XGetImage(d->display, root, x, y, w, h, AllPlanes,
+                               ZPixmap)))
+        {
+                NFT_LOG(L_ERROR, "XGetImage() failed");
+                return NFT_FAILURE;
+        }
+
+        _store(&d->px, frame, image, 0, 0, w, h);
+        XDestroyImage(image);
+
+        return NFT_SUCCESS;
+}
+
+
 /** descriptor of this mechanism */
 CaptureMechanism XLIB = {
         .name = "Xlib",
+        .option = _option,
         .init = _init,
         .deinit = _deinit,
         .capture = _capture,
+        .capture_region = _capture_region,
+        .format = _format,
+        .is_big_endian = _is_big_endian,
+};
+
+#ifdef HAVE_XSHM
+/** descriptor of MIT-SHM mechanism */
+CaptureMechanism XSHM = {
+        .name = "XShm",
+        .option = _option,
+        .init = _shm_init,
+        .deinit = _shm_deinit,
+        .capture = _shm_capture,
+        .capture_region = _shm_capture_region,
         .format = _format,
         .is_big_endian = _is_big_endian,
 };
+#endif /* HAVE_XSHM */
 
 
 #endif /* HAVE_X */
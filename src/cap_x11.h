@@ -46,8 +46,22 @@
 
 
 
-/** declaration of our descriptor */
-CaptureMechanism                XLIB;
+/** declaration of our descriptors */
+extern CaptureMechanism         XLIB;
+#ifdef HAVE_XSHM
+extern CaptureMechanism         XSHM;
+#endif /* HAVE_XSHM */
+
+
+/** another X display, captured independently of the mechanism */
+typedef struct _X11Display X11Display;
+
+
+X11Display                     *x11_display_open(const char *name);
+void                            x11_display_close(X11Display * d);
+const char                     *x11_display_format(X11Display * d);
+bool                            x11_display_is_big_endian(X11Display * d);
+NftResult                       x11_display_capture(X11Display * d, LedFrame * frame, LedFrameCord x, LedFrameCord y);
 
 
 
@@ -0,0 +1,358 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#include "config.h"
+
+#ifdef HAVE_XCB
+
+#include <stdlib.h>
+#include <string.h>
+#include <xcb/xcb.h>
+#include <niftyled.h>
+#include "capture.h"
+#include "cap_xcb.h"
+
+
+
+/** private structure to hold info accros function-calls */
+static struct
+{
+        xcb_connection_t *connection;
+        xcb_screen_t *screen;
+        /** cookie of image request in flight */
+        xcb_get_image_cookie_t cookie;
+        /** true if there's a request in flight */
+        bool pending;
+        /** format of images of root window (NULL = unsupported) */
+        const char *format;
+} _c;
+
+
+
+
+/**
+ * request image at x/y from X server without waiting for the reply
+ */
+static NftResult _request(LedFrame * frame, LedFrameCord x, LedFrameCord y)
+{
+        if(!frame)
+                NFT_LOG_NULL(NFT_FAILURE);
+
+        /* get frame dimensions */
+        LedFrameCord w, h;
+        if(!led_frame_get_dim(frame, &w, &h))
+                return NFT_FAILURE;
+
+        /* drop stale reply */
+        if(_c.pending)
+                xcb_discard_reply(_c.connection, _c.cookie.sequence);
+
+        _c.cookie = xcb_get_image(_c.connection, XCB_IMAGE_FORMAT_Z_PIXMAP,
+                                  _c.screen->root, x, y, w, h, ~0);
+        xcb_flush(_c.connection);
+        _c.pending = true;
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * wait for reply of last request and store image in frame
+ */
+static NftResult _collect(LedFrame * frame)
+{
+        if(!frame)
+                NFT_LOG_NULL(NFT_FAILURE);
+
+        if(!_c.pending)
+        {
+                NFT_LOG(L_ERROR, "No image requested. This is a bug!");
+                return NFT_FAILURE;
+        }
+        _c.pending = false;
+
+        /* get frame dimensions */
+        LedFrameCord w, h;
+        if(!led_frame_get_dim(frame, &w, &h))
+                return NFT_FAILURE;
+
+        xcb_generic_error_t *error = NULL;
+        xcb_get_image_reply_t *reply;
+        if(!(reply = xcb_get_image_reply(_c.connection, _c.cookie, &error)))
+        {
+                NFT_LOG(L_ERROR, "xcb_get_image() failed (error %d)",
+                        error ? error->error_code : 0);
+                free(error);
+                return NFT_FAILURE;
+        }
+
+        /* copy framebuffer (row by row if scanlines are padded) */
+        uint8_t *src = xcb_get_image_data(reply);
+        size_t srcstride = xcb_get_image_data_length(reply) / h;
+        size_t stride = (size_t) w *
+                led_pixel_format_get_bytes_per_pixel(led_frame_get_format
+                                                     (frame));
+        char *dst = led_frame_get_buffer(frame);
+        if(stride == srcstride)
+        {
+                memcpy(dst, src, led_frame_get_buffersize(frame));
+        }
+        else
+        {
+                if(stride > srcstride)
+                        stride = srcstride;
+
+                LedFrameCord row;
+                for(row = 0; row < h; row++)
+                {
+                        memcpy(dst + row * stride, src + row * srcstride,
+                               stride);
+                }
+        }
+
+        free(reply);
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * capture image (blocking)
+ */
+static NftResult _capture(LedFrame * frame, LedFrameCord x, LedFrameCord y)
+{
+        if(!_request(frame, x, y))
+                return NFT_FAILURE;
+
+        return _collect(frame);
+}
+
+
+/**
+ * find format of images from depth, bits per pixel & masks of the root
+ * visual. Images are copied as they are, so only layouts a pixel-format
+ * describes are supported (use the Xlib mechanism for others).
+ */
+static NftResult _layout()
+{
+        /* find visual of root window */
+        xcb_visualtype_t *visual = NULL;
+        xcb_depth_iterator_t d;
+        for(d = xcb_screen_allowed_depths_iterator(_c.screen);
+            d.rem && !visual; xcb_depth_next(&d))
+        {
+                xcb_visualtype_iterator_t v;
+                for(v = xcb_depth_visuals_iterator(d.data); v.rem;
+                    xcb_visualtype_next(&v))
+                {
+                        if(v.data->visual_id == _c.screen->root_visual)
+                        {
+                                visual = v.data;
+                                break;
+                        }
+                }
+        }
+
+        if(!visual)
+        {
+                NFT_LOG(L_ERROR, "Didn't find our visual?!");
+                return NFT_FAILURE;
+        }
+
+        /* bits per pixel of images with root depth */
+        const xcb_setup_t *setup = xcb_get_setup(_c.connection);
+        int bpp = 0;
+        xcb_format_iterator_t f;
+        for(f = xcb_setup_pixmap_formats_iterator(setup); f.rem;
+            xcb_format_next(&f))
+        {
+                if(f.data->depth == _c.screen->root_depth)
+                        bpp = f.data->bits_per_pixel;
+        }
+
+        NFT_LOG(L_VERBOSE, "Depth: %d, %d bits per pixel, Red-mask: 0x%x "
+                "Green-mask: 0x%x Blue-mask: 0x%x",
+                _c.screen->root_depth, bpp, visual->red_mask,
+                visual->green_mask, visual->blue_mask);
+
+        /* 5:6:5 is only understood in host byte-order */
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        bool native = setup->image_byte_order == XCB_IMAGE_ORDER_LSB_FIRST;
+#else
+        bool native = setup->image_byte_order == XCB_IMAGE_ORDER_MSB_FIRST;
+#endif
+
+        if((visual->_class == XCB_VISUAL_CLASS_TRUE_COLOR ||
+            visual->_class == XCB_VISUAL_CLASS_DIRECT_COLOR) &&
+           bpp == 32 && visual->red_mask == 0xff0000 &&
+           visual->green_mask == 0xff00 && visual->blue_mask == 0xff)
+        {
+                _c.format = "ARGB u8";
+        }
+        else if((visual->_class == XCB_VISUAL_CLASS_TRUE_COLOR ||
+                 visual->_class == XCB_VISUAL_CLASS_DIRECT_COLOR) &&
+                bpp == 16 && native && visual->red_mask == 0xf800 &&
+                visual->green_mask == 0x7e0 && visual->blue_mask == 0x1f)
+        {
+                _c.format = "RGB 565";
+        }
+        else
+        {
+                NFT_LOG(L_ERROR,
+                        "Visual (depth %d, %d bits per pixel) not supported by XCB mechanism, use Xlib",
+                        _c.screen->root_depth, bpp);
+                return NFT_FAILURE;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * initialize capture mechanism
+ */
+static NftResult _init()
+{
+        int screen;
+
+        /* connect to display */
+        _c.connection = xcb_connect(NULL, &screen);
+        if(xcb_connection_has_error(_c.connection))
+        {
+                NFT_LOG(L_ERROR, "Can't connect to X server.");
+                xcb_disconnect(_c.connection);
+                _c.connection = NULL;
+                return NFT_FAILURE;
+        }
+
+        /* find our screen */
+        xcb_screen_iterator_t i;
+        i = xcb_setup_roots_iterator(xcb_get_setup(_c.connection));
+        for(; i.rem; screen--, xcb_screen_next(&i))
+        {
+                if(screen == 0)
+                {
+                        _c.screen = i.data;
+                        break;
+                }
+        }
+
+        if(!_c.screen)
+        {
+                NFT_LOG(L_ERROR, "Didn't find default screen?!");
+                xcb_disconnect(_c.connection);
+                _c.connection = NULL;
+                return NFT_FAILURE;
+        }
+
+        if(!_layout())
+        {
+                xcb_disconnect(_c.connection);
+                _c.connection = NULL;
+                _c.screen = NULL;
+                return NFT_FAILURE;
+        }
+
+        _c.pending = false;
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * deinitialize capture mechanism
+ */
+static void _deinit()
+{
+        /* close connection to display */
+        if(_c.connection)
+                xcb_disconnect(_c.connection);
+        _c.connection = NULL;
+        _c.screen = NULL;
+        _c.format = NULL;
+}
+
+
+/**
+ * return prefered frame format
+ */
+static const char *_format()
+{
+        if(!_c.screen)
+                NFT_LOG_NULL(NULL);
+
+        return _c.format;
+}
+
+
+/**
+ * return whether capture mechanism delivers big-endian ordered data
+ */
+static bool _is_big_endian()
+{
+        /* same semantics as Xlib mechanism (5:6:5 is in host byte-order) */
+        if(_c.format && strcmp(_c.format, "RGB 565") == 0)
+                return false;
+
+        if(xcb_get_setup(_c.connection)->image_byte_order ==
+           XCB_IMAGE_ORDER_LSB_FIRST)
+                return true;
+        else
+                return false;
+}
+
+
+/** descriptor of this mechanism */
+CaptureMechanism XCB = {
+        .name = "XCB",
+        .init = _init,
+        .deinit = _deinit,
+        .capture = _capture,
+        .request = _request,
+        .collect = _collect,
+        .format = _format,
+        .is_big_endian = _is_big_endian,
+};
+
+
+#endif /* HAVE_XCB */
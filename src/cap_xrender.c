@@ -0,0 +1,595 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * capture mechanism that lets the X server scale the capture rectangle
+ * down to the size of the frame using XRender, so only the small image has
+ * to be transferred
+ *
+ * options:
+ *      width   width of screen rectangle to scale from (default: up to
+ *              right edge of screen)
+ *      height  height of screen rectangle to scale from (default: up to
+ *              bottom edge of screen)
+ *      filter  "box" averages all pixels covered by a frame pixel
+ *              (default), anything else is passed to XRender as filter
+ *              name (e.g. "bilinear", "nearest", "good", "fast")
+ */
+
+#include "config.h"
+
+#if defined(HAVE_X) && defined(HAVE_XRENDER)
+
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/Xrender.h>
+#ifdef HAVE_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif /* HAVE_XSHM */
+#include <niftyled.h>
+#include "capture.h"
+#include "cap_xrender.h"
+
+
+/** largest box-filter kernel (per dimension), larger scales are sampled */
+#define BOX_MAX 64
+
+
+/** private structure to hold info accros function-calls */
+static struct
+{
+        Display *display;
+        int screen;
+        /** last X error code (set by _err_handler) */
+        int error;
+        /** width of screen rectangle (0 = up to edge of screen) */
+        LedFrameCord width;
+        /** height of screen rectangle (0 = up to edge of screen) */
+        LedFrameCord height;
+        /** filter used for scaling */
+        char filter[32];
+        /** picture of root window (scaling source) */
+        Picture root;
+        /** pixmap holding scaled image */
+        Pixmap pixmap;
+        /** picture of pixmap (scaling destination) */
+        Picture scaled;
+        /** dimensions of pixmap */
+        LedFrameCord w, h;
+        /** source rectangle the transform of root was set for */
+        LedFrameCord sx, sy, sw, sh;
+#ifdef HAVE_XSHM
+        /** true if MIT-SHM is used to fetch scaled image */
+        bool shm;
+        /** persistent image living in shared memory */
+        XImage *image;
+        /** shared memory segment backing image */
+        XShmSegmentInfo shminfo;
+#endif /* HAVE_XSHM */
+} _c = {
+        .filter = "box",
+};
+
+
+
+
+/** X11 Error handler */
+static int _err_handler(Display * d, XErrorEvent * err)
+{
+        char msg[256];
+        XGetErrorText(d, err->error_code, msg, sizeof(msg));
+        NFT_LOG(L_DEBUG, "X error: %s", msg);
+        _c.error = err->error_code;
+        return 0;
+}
+
+
+/**
+ * set option
+ */
+static NftResult _option(const char *key, const char *value)
+{
+        if(strcmp(key, "width") == 0)
+        {
+                if((_c.width = atoi(value)) < 0)
+                {
+                        NFT_LOG(L_ERROR, "Invalid width: %s", value);
+                        return NFT_FAILURE;
+                }
+        }
+        else if(strcmp(key, "height") == 0)
+        {
+                if((_c.height = atoi(value)) < 0)
+                {
+                        NFT_LOG(L_ERROR, "Invalid height: %s", value);
+                        return NFT_FAILURE;
+                }
+        }
+        else if(strcmp(key, "filter") == 0)
+        {
+                if(strlen(value) >= sizeof(_c.filter))
+                {
+                        NFT_LOG(L_ERROR, "Filter name \"%s\" too long",
+                                value);
+                        return NFT_FAILURE;
+                }
+                strcpy(_c.filter, value);
+        }
+        else
+        {
+                NFT_LOG(L_ERROR, "Unknown option \"%s\"", key);
+                return NFT_FAILURE;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * set transform & filter of root picture so w x h destination pixels
+ * cover the source rectangle
+ */
+static NftResult _transform(LedFrameCord x, LedFrameCord y,
+                            LedFrameCord sw, LedFrameCord sh,
+                            LedFrameCord w, LedFrameCord h)
+{
+        double fx = (double) sw / w, fy = (double) sh / h;
+
+        /* maps destination to source coordinates */
+        XTransform t = {{
+                        {XDoubleToFixed(fx), 0, XDoubleToFixed(x)},
+                        {0, XDoubleToFixed(fy), XDoubleToFixed(y)},
+                        {0, 0, XDoubleToFixed(1)},
+                        }
+        };
+        XRenderSetPictureTransform(_c.display, _c.root, &t);
+
+        if(strcmp(_c.filter, "box") != 0)
+        {
+                XRenderSetPictureFilter(_c.display, _c.root, _c.filter,
+                                        NULL, 0);
+        }
+        else
+        {
+                /* convolve with box as large as the area of a destination
+                   pixel, so every pixel of that area counts the same */
+                int kw = (int) (fx + 0.5), kh = (int) (fy + 0.5);
+                kw = kw < 1 ? 1 : (kw > BOX_MAX ? BOX_MAX : kw);
+                kh = kh < 1 ? 1 : (kh > BOX_MAX ? BOX_MAX : kh);
+
+                XFixed *params;
+                if(!(params = malloc((2 + kw * kh) * sizeof(XFixed))))
+                {
+                        NFT_LOG_PERROR("malloc()");
+                        return NFT_FAILURE;
+                }
+
+                params[0] = XDoubleToFixed(kw);
+                params[1] = XDoubleToFixed(kh);
+                int i;
+                for(i = 0; i < kw * kh; i++)
+                        params[2 + i] = XDoubleToFixed(1.0 / (kw * kh));
+
+                XRenderSetPictureFilter(_c.display, _c.root,
+                                        FilterConvolution, params,
+                                        2 + kw * kh);
+                free(params);
+        }
+
+        _c.sx = x;
+        _c.sy = y;
+        _c.sw = sw;
+        _c.sh = sh;
+
+        NFT_LOG(L_VERBOSE, "Scaling %dx%d at %d/%d to %dx%d (filter: %s)",
+                sw, sh, x, y, w, h, _c.filter);
+
+        return NFT_SUCCESS;
+}
+
+
+#ifdef HAVE_XSHM
+
+/**
+ * destroy shared-memory image (if any)
+ */
+static void _shm_image_destroy()
+{
+        if(!_c.image)
+                return;
+
+        XShmDetach(_c.display, &_c.shminfo);
+        XDestroyImage(_c.image);
+        shmdt(_c.shminfo.shmaddr);
+        _c.image = NULL;
+}
+
+
+/**
+ * create shared-memory image of w x h pixels
+ */
+static NftResult _shm_image_create(LedFrameCord w, LedFrameCord h)
+{
+        if(!(_c.image = XShmCreateImage(_c.display,
+                                        DefaultVisual(_c.display, _c.screen),
+                                        DefaultDepth(_c.display, _c.screen),
+                                        ZPixmap, NULL, &_c.shminfo, w, h)))
+        {
+                NFT_LOG(L_ERROR, "XShmCreateImage() failed");
+                return NFT_FAILURE;
+        }
+
+        if((_c.shminfo.shmid = shmget(IPC_PRIVATE,
+                                      _c.image->bytes_per_line *
+                                      _c.image->height,
+                                      IPC_CREAT | 0600)) < 0)
+        {
+                NFT_LOG_PERROR("shmget()");
+                goto _sic_error;
+        }
+
+        if((_c.shminfo.shmaddr = shmat(_c.shminfo.shmid, NULL, 0)) ==
+           (void *) -1)
+        {
+                NFT_LOG_PERROR("shmat()");
+                shmctl(_c.shminfo.shmid, IPC_RMID, NULL);
+                goto _sic_error;
+        }
+        _c.image->data = _c.shminfo.shmaddr;
+        _c.shminfo.readOnly = False;
+
+        _c.error = 0;
+        XShmAttach(_c.display, &_c.shminfo);
+        XSync(_c.display, False);
+
+        /* segment is destroyed as soon as both sides detached */
+        shmctl(_c.shminfo.shmid, IPC_RMID, NULL);
+
+        if(_c.error)
+        {
+                NFT_LOG(L_ERROR,
+                        "XShmAttach() failed. (Not a local X server?)");
+                shmdt(_c.shminfo.shmaddr);
+                goto _sic_error;
+        }
+
+        return NFT_SUCCESS;
+
+_sic_error:
+        XDestroyImage(_c.image);
+        _c.image = NULL;
+        return NFT_FAILURE;
+}
+
+#endif /* HAVE_XSHM */
+
+
+/**
+ * free destination pixmap & everything depending on its size
+ */
+static void _target_destroy()
+{
+#ifdef HAVE_XSHM
+        _shm_image_destroy();
+#endif /* HAVE_XSHM */
+
+        if(_c.scaled)
+                XRenderFreePicture(_c.display, _c.scaled);
+        _c.scaled = None;
+
+        if(_c.pixmap)
+                XFreePixmap(_c.display, _c.pixmap);
+        _c.pixmap = None;
+
+        _c.w = _c.h = 0;
+}
+
+
+/**
+ * create destination pixmap of w x h pixels
+ */
+static NftResult _target_create(LedFrameCord w, LedFrameCord h)
+{
+        Window root = RootWindow(_c.display, _c.screen);
+
+        _c.pixmap = XCreatePixmap(_c.display, root, w, h,
+                                  DefaultDepth(_c.display, _c.screen));
+
+        XRenderPictFormat *f;
+        if(!(f = XRenderFindVisualFormat(_c.display,
+                                         DefaultVisual(_c.display,
+                                                       _c.screen))))
+        {
+                NFT_LOG(L_ERROR, "No XRender format for default visual");
+                return NFT_FAILURE;
+        }
+        _c.scaled = XRenderCreatePicture(_c.display, _c.pixmap, f, 0, NULL);
+
+#ifdef HAVE_XSHM
+        /* fall back to XGetImage() if segment can't be attached */
+        if(_c.shm && !_shm_image_create(w, h))
+        {
+                NFT_LOG(L_WARNING, "Not using MIT-SHM");
+                _c.shm = false;
+        }
+#endif /* HAVE_XSHM */
+
+        _c.w = w;
+        _c.h = h;
+
+        /* force new transform */
+        _c.sw = _c.sh = 0;
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * copy image with padded scanlines to frame
+ */
+static void _copy(LedFrame * frame, XImage * image, LedFrameCord h)
+{
+        size_t stride = (size_t) _c.w *
+                led_pixel_format_get_bytes_per_pixel(led_frame_get_format
+                                                     (frame));
+        char *dst = led_frame_get_buffer(frame);
+
+        if(stride == (size_t) image->bytes_per_line)
+        {
+                memcpy(dst, image->data, led_frame_get_buffersize(frame));
+                return;
+        }
+
+        if(stride > (size_t) image->bytes_per_line)
+                stride = image->bytes_per_line;
+
+        LedFrameCord row;
+        for(row = 0; row < h; row++)
+                memcpy(dst + row * stride,
+                       image->data + row * image->bytes_per_line, stride);
+}
+
+
+/**
+ * capture scaled image
+ */
+static NftResult _capture(LedFrame * frame, LedFrameCord x, LedFrameCord y)
+{
+        if(!frame)
+                NFT_LOG_NULL(NFT_FAILURE);
+
+        /* get frame dimensions */
+        LedFrameCord w, h;
+        if(!led_frame_get_dim(frame, &w, &h))
+                return NFT_FAILURE;
+
+        /* size of screen rectangle */
+        LedFrameCord sw = _c.width, sh = _c.height;
+        if(!sw)
+                sw = DisplayWidth(_c.display, _c.screen) - x;
+        if(!sh)
+                sh = DisplayHeight(_c.display, _c.screen) - y;
+
+        if(sw < w || sh < h)
+        {
+                NFT_LOG(L_ERROR,
+                        "Screen rectangle %dx%d smaller than frame %dx%d",
+                        sw, sh, w, h);
+                return NFT_FAILURE;
+        }
+
+        /* (re-)create pixmap when frame dimensions changed */
+        if(_c.w != w || _c.h != h)
+        {
+                _target_destroy();
+                if(!_target_create(w, h))
+                        return NFT_FAILURE;
+        }
+
+        if((_c.sx != x || _c.sy != y || _c.sw != sw || _c.sh != sh) &&
+           !_transform(x, y, sw, sh, w, h))
+                return NFT_FAILURE;
+
+        /* scale screen rectangle into pixmap */
+        _c.error = 0;
+        XRenderComposite(_c.display, PictOpSrc, _c.root, None, _c.scaled,
+                         0, 0, 0, 0, 0, 0, w, h);
+
+#ifdef HAVE_XSHM
+        if(_c.shm)
+        {
+                if(!XShmGetImage(_c.display, _c.pixmap, _c.image, 0, 0,
+                                 AllPlanes))
+                {
+                        NFT_LOG(L_ERROR, "XShmGetImage() failed");
+                        return NFT_FAILURE;
+                }
+
+                _copy(frame, _c.image, h);
+        }
+        else
+#endif /* HAVE_XSHM */
+        {
+                XImage *image;
+                if(!(image = XGetImage(_c.display, _c.pixmap, 0, 0, w, h,
+                                       AllPlanes, ZPixmap)))
+                {
+                        NFT_LOG(L_ERROR, "XGetImage() failed");
+                        return NFT_FAILURE;
+                }
+
+                _copy(frame, image, h);
+                XDestroyImage(image);
+        }
+
+        /* composite errors arrive with the reply to the image request */
+        if(_c.error)
+        {
+                NFT_LOG(L_ERROR, "XRender failed to scale screen");
+                return NFT_FAILURE;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * deinitialize capture mechanism
+ */
+static void _deinit()
+{
+        if(!_c.display)
+                return;
+
+        _target_destroy();
+
+        if(_c.root)
+                XRenderFreePicture(_c.display, _c.root);
+        _c.root = None;
+
+        XCloseDisplay(_c.display);
+        _c.display = NULL;
+}
+
+
+/**
+ * initialize capture mechanism
+ */
+static NftResult _init()
+{
+        /* connect to display */
+        if(!(_c.display = XOpenDisplay(NULL)))
+        {
+                NFT_LOG(L_ERROR, "Failed to open display");
+                return NFT_FAILURE;
+        }
+
+        _c.screen = DefaultScreen(_c.display);
+        XSetErrorHandler(_err_handler);
+
+        int event, error;
+        if(!XRenderQueryExtension(_c.display, &event, &error))
+        {
+                NFT_LOG(L_ERROR, "X server doesn't support XRender extension");
+                goto _i_error;
+        }
+
+        /* picture of root window including all windows on it */
+        XRenderPictFormat *f;
+        if(!(f = XRenderFindVisualFormat(_c.display,
+                                         DefaultVisual(_c.display,
+                                                       _c.screen))))
+        {
+                NFT_LOG(L_ERROR, "No XRender format for default visual");
+                goto _i_error;
+        }
+
+        XRenderPictureAttributes a = {.subwindow_mode = IncludeInferiors };
+        _c.root = XRenderCreatePicture(_c.display,
+                                       RootWindow(_c.display, _c.screen), f,
+                                       CPSubwindowMode, &a);
+
+#ifdef HAVE_XSHM
+        _c.shm = XShmQueryExtension(_c.display);
+#endif /* HAVE_XSHM */
+
+        return NFT_SUCCESS;
+
+_i_error:
+        _deinit();
+        return NFT_FAILURE;
+}
+
+
+/**
+ * return frame format (default visual as 32 bit pixels)
+ */
+static const char *_format()
+{
+        if(!_c.display)
+                NFT_LOG_NULL(NULL);
+
+        XRenderPictFormat *f;
+        if(!(f = XRenderFindVisualFormat(_c.display,
+                                         DefaultVisual(_c.display,
+                                                       _c.screen))))
+                return NULL;
+
+        /* only the common 24/32 bit TrueColor layout */
+        if(f->direct.red != 16 || f->direct.green != 8 ||
+           f->direct.blue != 0 || f->direct.redMask != 0xff)
+        {
+                NFT_LOG(L_ERROR, "Unsupported visual (depth %d)", f->depth);
+                return NULL;
+        }
+
+        return "ARGB u8";
+}
+
+
+/**
+ * return whether capture mechanism delivers big-endian ordered data
+ */
+static bool _is_big_endian()
+{
+        return XImageByteOrder(_c.display) == LSBFirst;
+}
+
+
+/** descriptor of this mechanism */
+CaptureMechanism XRENDER = {
+        .name = "XRender",
+        .option = _option,
+        .init = _init,
+        .deinit = _deinit,
+        .capture = _capture,
+        .format = _format,
+        .is_big_endian = _is_big_endian,
+};
+
+
+#endif /* HAVE_X && HAVE_XRENDER */
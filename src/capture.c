@@ -51,6 +51,20 @@
 #ifdef HAVE_IMLIB
 #include "cap_imlib.h"
 #endif /* HAVE_IMLIB */
+#ifdef HAVE_XCB
+#include "cap_xcb.h"
+#endif /* HAVE_XCB */
+#if defined(HAVE_X) && defined(HAVE_XRENDER)
+#include "cap_xrender.h"
+#endif /* HAVE_X && HAVE_XRENDER */
+#if defined(HAVE_X) && defined(HAVE_XCOMPOSITE)
+#include "cap_composite.h"
+#endif /* HAVE_X && HAVE_XCOMPOSITE */
+#include "cap_pattern.h"
+#include "cap_mmap.h"
+#include "cap_pipe.h"
+#include "cap_shm.h"
+#include "convert.h"
 
 
 /** private structure to hold infos for this module */
@@ -58,6 +72,14 @@ static struct
 {
         /** currently used capture method */
         CaptureMethod method;
+        /** true if capture_request() was called without capture_collect() */
+        bool pending;
+        /** x-offset of requested capture */
+        LedFrameCord x;
+        /** y-offset of requested capture */
+        LedFrameCord y;
+        /** amount of failed captures */
+        unsigned long failures;
 } _c;
 
 /** all registered capture-methods */
@@ -67,11 +89,43 @@ static CaptureMechanism *_mechanisms[] = {
         &XLIB,
 #endif /* HAVE_X */
 
+#ifdef HAVE_XSHM
+        /** X11 capture using MIT-SHM extension (local X server only) */
+        &XSHM,
+#endif /* HAVE_XSHM */
+
 #ifdef HAVE_IMLIB
         /** use imlib + X11 to capture screen */
         &IMLIB,
 #endif /* HAVE_IMLIB */
 
+#ifdef HAVE_XCB
+        /** asynchronous capture using xcb_get_image() */
+        &XCB,
+#endif /* HAVE_XCB */
+
+#if defined(HAVE_X) && defined(HAVE_XRENDER)
+        /** let X server scale screen down to frame size with XRender */
+        &XRENDER,
+#endif /* HAVE_X && HAVE_XRENDER */
+
+#if defined(HAVE_X) && defined(HAVE_XCOMPOSITE)
+        /** capture one (possibly occluded) window through XComposite */
+        &COMPOSITE,
+#endif /* HAVE_X && HAVE_XCOMPOSITE */
+
+        /** synthetic test-patterns, no display needed */
+        &PATTERN,
+
+        /** copy from memory-mapped framebuffer device or file */
+        &MMAP,
+
+        /** raw frames from stdin or a fifo */
+        &PIPE,
+
+        /** frames published to a shared-memory ring by another process */
+        &SHM,
+
         /** add descriptor of new mechanism above this line
            don't forget to add CaptureMethod in capture.h */
         NULL,
@@ -145,6 +199,7 @@ NftResult capture_frame(LedFrame * f, LedFrameCord x, LedFrameCord y)
                         NFT_LOG(L_ERROR,
                                 "Capture with mechanism \"%s\" failed",
                                 MECHANISM(_c.method)->name);
+                        __atomic_add_fetch(&_c.failures, 1, __ATOMIC_RELAXED);
                         return NFT_FAILURE;
                 }
         }
@@ -162,6 +217,136 @@ NftResult capture_frame(LedFrame * f, LedFrameCord x, LedFrameCord y)
 }
 
 
+/**
+ * start capturing a frame. Mechanisms that support it will send the request
+ * and return immediately so capture_collect() can pick up the result later.
+ * Other mechanisms will capture when capture_collect() is called.
+ */
+NftResult capture_request(LedFrame * f, LedFrameCord x, LedFrameCord y)
+{
+        if(MECHANISM(_c.method)->request)
+        {
+                NFT_LOG(L_DEBUG, "Requesting image x: %d, y: %d", x, y);
+
+                if(!(MECHANISM(_c.method)->request(f, x, y)))
+                {
+                        NFT_LOG(L_ERROR,
+                                "Capture request with mechanism \"%s\" failed",
+                                MECHANISM(_c.method)->name);
+                        __atomic_add_fetch(&_c.failures, 1, __ATOMIC_RELAXED);
+                        return NFT_FAILURE;
+                }
+        }
+
+        _c.x = x;
+        _c.y = y;
+        _c.pending = true;
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * finish capture started by capture_request()
+ */
+NftResult capture_collect(LedFrame * f)
+{
+        if(!_c.pending)
+        {
+                NFT_LOG(L_ERROR, "capture_collect() without capture_request()");
+                return NFT_FAILURE;
+        }
+        _c.pending = false;
+
+        /* mechanism can't split capture, capture now */
+        if(!MECHANISM(_c.method)->collect)
+                return capture_frame(f, _c.x, _c.y);
+
+        if(!(MECHANISM(_c.method)->collect(f)))
+        {
+                NFT_LOG(L_ERROR,
+                        "Collecting capture with mechanism \"%s\" failed",
+                        MECHANISM(_c.method)->name);
+                __atomic_add_fetch(&_c.failures, 1, __ATOMIC_RELAXED);
+                return NFT_FAILURE;
+        }
+
+        /* set endianness (flag will be changed when conversion occurs) */
+        led_frame_set_big_endian(f, capture_is_big_endian());
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * capture only some rectangles of a frame, leave rest of frame untouched
+ * (mechanisms that can't capture regions capture the whole frame)
+ */
+NftResult capture_frame_regions(LedFrame * f, LedFrameCord x, LedFrameCord y,
+                                CaptureRect * rects, size_t n)
+{
+        if(!MECHANISM(_c.method)->capture_region)
+                return capture_frame(f, x, y);
+
+        size_t i;
+        for(i = 0; i < n; i++)
+        {
+                NFT_LOG(L_DEBUG, "Capturing region x: %d, y: %d, %dx%d",
+                        rects[i].x, rects[i].y, rects[i].w, rects[i].h);
+
+                if(!(MECHANISM(_c.method)->capture_region(f, x, y, &rects[i])))
+                {
+                        NFT_LOG(L_ERROR,
+                                "Region capture with mechanism \"%s\" failed",
+                                MECHANISM(_c.method)->name);
+                        __atomic_add_fetch(&_c.failures, 1, __ATOMIC_RELAXED);
+                        return NFT_FAILURE;
+                }
+        }
+
+        /* set endianness (flag will be changed when conversion occurs) */
+        led_frame_set_big_endian(f, capture_is_big_endian());
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * set mechanism specific option (call before capture_init())
+ */
+NftResult capture_option(CaptureMethod m, const char *key, const char *value)
+{
+        if(!key || !value)
+                NFT_LOG_NULL(NFT_FAILURE);
+
+        if(!METHOD_VALID(m))
+        {
+                NFT_LOG(L_ERROR, "Invalid capture method");
+                return NFT_FAILURE;
+        }
+
+        if(!MECHANISM(m)->option)
+        {
+                NFT_LOG(L_ERROR, "Mechanism \"%s\" has no options",
+                        MECHANISM(m)->name);
+                return NFT_FAILURE;
+        }
+
+        NFT_LOG(L_VERBOSE, "Setting option \"%s\" of \"%s\" to \"%s\"",
+                key, MECHANISM(m)->name, value);
+
+        if(!MECHANISM(m)->option(key, value))
+        {
+                NFT_LOG(L_ERROR,
+                        "Setting option \"%s\" of mechanism \"%s\" failed",
+                        key, MECHANISM(m)->name);
+                return NFT_FAILURE;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
 /**
  * initialize capture-mechanism 
  */
@@ -177,6 +362,9 @@ NftResult capture_init(CaptureMethod m)
         NFT_LOG(L_VERBOSE, "Initializing capture-method \"%s\"",
                 MECHANISM(m)->name);
 
+        /* select conversion kernels for this CPU */
+        convert_init();
+
         /* initialize capture-method */
         if(MECHANISM(m)->init)
         {
@@ -191,6 +379,7 @@ NftResult capture_init(CaptureMethod m)
 
         /* save capture-method */
         _c.method = m;
+        _c.pending = false;
 
         return NFT_SUCCESS;
 }
@@ -211,6 +400,13 @@ void capture_deinit()
 }
 
 
+/** amount of captures that failed */
+unsigned long capture_failures()
+{
+        return __atomic_load_n(&_c.failures, __ATOMIC_RELAXED);
+}
+
+
 /** return format-string suitable for this capture-mechanism */
 const char *capture_format()
 {
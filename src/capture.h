@@ -52,19 +52,47 @@ typedef enum
 #ifdef HAVE_X
         METHOD_XLIB,
 #endif /* HAVE_X */
+#ifdef HAVE_XSHM
+        METHOD_XSHM,
+#endif /* HAVE_XSHM */
 #ifdef HAVE_IMLIB
         METHOD_IMLIB,
 #endif /* HAVE_IMLIB */
+#ifdef HAVE_XCB
+        METHOD_XCB,
+#endif /* HAVE_XCB */
+#if defined(HAVE_X) && defined(HAVE_XRENDER)
+        METHOD_XRENDER,
+#endif /* HAVE_X && HAVE_XRENDER */
+#if defined(HAVE_X) && defined(HAVE_XCOMPOSITE)
+        METHOD_COMPOSITE,
+#endif /* HAVE_X && HAVE_XCOMPOSITE */
+        METHOD_PATTERN,
+        METHOD_MMAP,
+        METHOD_PIPE,
+        METHOD_SHM,
         /* insert new method above this line don't forget to add the descriptor to _mechanisms[] in capture.c */
         METHOD_MAX,
 } CaptureMethod;
 
 
+/** rectangle relative to the origin of a captured frame */
+typedef struct
+{
+        LedFrameCord                    x;
+        LedFrameCord                    y;
+        LedFrameCord                    w;
+        LedFrameCord                    h;
+} CaptureRect;
+
+
 /** the descriptor for a capture mechanism */
 typedef struct
 {
         /** name of this mechanism */
         char                            name[32];
+        /** set mechanism specific option before init (optional) */
+                                        NftResult(*option) (const char *, const char *);
         /** initialization function */
                                         NftResult(*init) (void);
         /** deinitalization function */
@@ -75,10 +103,16 @@ typedef struct
                                         bool(*is_big_endian) (void);
         /** capture image */
                                         NftResult(*capture) (LedFrame *, LedFrameCord, LedFrameCord);
+        /** capture rectangle of image into same position of frame (optional) */
+                                        NftResult(*capture_region) (LedFrame *, LedFrameCord, LedFrameCord, CaptureRect *);
+        /** start capturing image without waiting for it (optional, needs collect) */
+                                        NftResult(*request) (LedFrame *, LedFrameCord, LedFrameCord);
+        /** wait for image of last request and store it in frame (optional, needs request) */
+                                        NftResult(*collect) (LedFrame *);
 } CaptureMechanism;
 
 /** macro to check if a capture-method is valid */
-#define METHOD_VALID(m) ((m > METHOD_MIN) && (m < METHOD_MAX))
+#define METHOD_VALID(m) (((m) > METHOD_MIN) && ((m) < METHOD_MAX))
 
 
 
@@ -88,6 +122,11 @@ CaptureMethod                   capture_method_from_string(const char *name);
 bool                            capture_is_big_endian();
 const char                     *capture_format();
 NftResult                       capture_frame(LedFrame * frame, LedFrameCord x, LedFrameCord y);
+NftResult                       capture_request(LedFrame * frame, LedFrameCord x, LedFrameCord y);
+NftResult                       capture_collect(LedFrame * frame);
+NftResult                       capture_frame_regions(LedFrame * frame, LedFrameCord x, LedFrameCord y, CaptureRect * rects, size_t n);
+unsigned long                   capture_failures();
+NftResult                       capture_option(CaptureMethod m, const char *key, const char *value);
 NftResult                       capture_init(CaptureMethod m);
 void                            capture_deinit();
 
@@ -0,0 +1,706 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * pixel-format conversion of captured frames
+ *
+ * Every conversion has a scalar reference implementation and optional
+ * SIMD versions (SSSE3 & AVX2 on x86, NEON on ARM). convert_init() picks
+ * the fastest one the CPU supports. DEBUG builds compare every selected
+ * SIMD kernel against the scalar one and fall back to scalar on mismatch.
+ *
+ * SIMD loops store whole vectors and only advance by the bytes they
+ * converted, so they stop early enough to never write past dst. The rest
+ * is done by the scalar kernel.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <niftyled.h>
+#include "convert.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CONVERT_X86
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define CONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+
+/** one conversion function */
+typedef void (*ConvertFunc) (uint8_t * dst, const uint8_t * src,
+                             size_t pixels);
+
+/** an implementation of all conversions */
+typedef struct
+{
+        /** name of implementation */
+        const char *name;
+        /** kernels (NULL if not implemented) */
+        ConvertFunc kernels[CONVERT_MAX];
+} ConvertImpl;
+
+
+/** private structure to hold info accros function-calls */
+static struct
+{
+        /** selected kernel for every conversion */
+        ConvertFunc kernels[CONVERT_MAX];
+        /** name of implementation of selected kernels */
+        const char *names[CONVERT_MAX];
+        /** true after convert_init() */
+        bool initialized;
+} _c;
+
+
+
+/******************************************************************************
+ * scalar reference
+ ******************************************************************************/
+
+static void _bgrx_rgb(uint8_t * d, const uint8_t * s, size_t n)
+{
+        size_t i;
+        for(i = 0; i < n; i++, d += 3, s += 4)
+        {
+                d[0] = s[2];
+                d[1] = s[1];
+                d[2] = s[0];
+        }
+}
+
+
+static void _xrgb_rgb(uint8_t * d, const uint8_t * s, size_t n)
+{
+        size_t i;
+        for(i = 0; i < n; i++, d += 3, s += 4)
+        {
+                d[0] = s[1];
+                d[1] = s[2];
+                d[2] = s[3];
+        }
+}
+
+
+static void _bswap32(uint8_t * d, const uint8_t * s, size_t n)
+{
+        size_t i;
+        for(i = 0; i < n; i++, d += 4, s += 4)
+        {
+                uint32_t p;
+                memcpy(&p, s, 4);
+                p = __builtin_bswap32(p);
+                memcpy(d, &p, 4);
+        }
+}
+
+
+static void _rgb565_rgb(uint8_t * d, const uint8_t * s, size_t n)
+{
+        size_t i;
+        for(i = 0; i < n; i++, d += 3, s += 2)
+        {
+                uint16_t p;
+                memcpy(&p, s, 2);
+                uint8_t r = (p >> 11) & 0x1f, g = (p >> 5) & 0x3f, b = p & 0x1f;
+                d[0] = (r << 3) | (r >> 2);
+                d[1] = (g << 2) | (g >> 4);
+                d[2] = (b << 3) | (b >> 2);
+        }
+}
+
+
+static void _bgr_rgb(uint8_t * d, const uint8_t * s, size_t n)
+{
+        size_t i;
+        for(i = 0; i < n; i++, d += 3, s += 3)
+        {
+                uint8_t b = s[0];
+                d[0] = s[2];
+                d[1] = s[1];
+                d[2] = b;
+        }
+}
+
+
+static void _x2rgb10_rgb16(uint8_t * d, const uint8_t * s, size_t n)
+{
+        size_t i;
+        for(i = 0; i < n; i++, d += 6, s += 4)
+        {
+                uint32_t p;
+                memcpy(&p, s, 4);
+                uint16_t c[3] = {
+                        (p >> 20) & 0x3ff, (p >> 10) & 0x3ff, p & 0x3ff
+                };
+                int j;
+                for(j = 0; j < 3; j++)
+                        c[j] = (c[j] << 6) | (c[j] >> 4);
+                memcpy(d, c, 6);
+        }
+}
+
+
+static const ConvertImpl _scalar = {
+        .name = "scalar",
+        .kernels = {
+                    [CONVERT_BGRX_RGB] = _bgrx_rgb,
+                    [CONVERT_XRGB_RGB] = _xrgb_rgb,
+                    [CONVERT_BSWAP32] = _bswap32,
+                    [CONVERT_RGB565_RGB] = _rgb565_rgb,
+                    [CONVERT_BGR_RGB] = _bgr_rgb,
+                    [CONVERT_X2RGB10_RGB16] = _x2rgb10_rgb16,
+                    },
+};
+
+
+
+#ifdef CONVERT_X86
+/******************************************************************************
+ * SSSE3 (pshufb)
+ ******************************************************************************/
+
+/** pick 3 of 4 bytes of 4 pixels, 12 bytes result */
+#define SHUF_BGRX_RGB 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+#define SHUF_XRGB_RGB 1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1
+#define SHUF_BSWAP32 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+
+
+/** 4 pixels of 32 bit to 24 bit per iteration */
+__attribute__ ((target("ssse3")))
+static size_t _shuffle24_ssse3(uint8_t * d, const uint8_t * s, size_t n,
+                               __m128i mask)
+{
+        size_t i;
+        /* every store writes 4 bytes more than it converted */
+        for(i = 0; i + 6 <= n; i += 4, d += 12, s += 16)
+        {
+                __m128i v = _mm_loadu_si128((const __m128i *) s);
+                _mm_storeu_si128((__m128i *) d, _mm_shuffle_epi8(v, mask));
+        }
+
+        return i;
+}
+
+
+__attribute__ ((target("ssse3")))
+static void _bgrx_rgb_ssse3(uint8_t * d, const uint8_t * s, size_t n)
+{
+        size_t i = _shuffle24_ssse3(d, s, n, _mm_setr_epi8(SHUF_BGRX_RGB));
+        _bgrx_rgb(d + i * 3, s + i * 4, n - i);
+}
+
+
+__attribute__ ((target("ssse3")))
+static void _xrgb_rgb_ssse3(uint8_t * d, const uint8_t * s, size_t n)
+{
+        size_t i = _shuffle24_ssse3(d, s, n, _mm_setr_epi8(SHUF_XRGB_RGB));
+        _xrgb_rgb(d + i * 3, s + i * 4, n - i);
+}
+
+
+__attribute__ ((target("ssse3")))
+static void _bswap32_ssse3(uint8_t * d, const uint8_t * s, size_t n)
+{
+        __m128i mask = _mm_setr_epi8(SHUF_BSWAP32);
+
+        size_t i;
+        for(i = 0; i + 4 <= n; i += 4, d += 16, s += 16)
+        {
+                __m128i v = _mm_loadu_si128((const __m128i *) s);
+                _mm_storeu_si128((__m128i *) d, _mm_shuffle_epi8(v, mask));
+        }
+
+        _bswap32(d, s, n - i);
+}
+
+
+/** expand 8 pixels of 5:6:5 to two vectors of R,G,B,0 */
+__attribute__ ((target("ssse3")))
+static void _565_expand_ssse3(const uint8_t * s, __m128i * lo, __m128i * hi)
+{
+        __m128i p = _mm_loadu_si128((const __m128i *) s);
+
+        __m128i r = _mm_and_si128(_mm_srli_epi16(p, 11), _mm_set1_epi16(0x1f));
+        __m128i g = _mm_and_si128(_mm_srli_epi16(p, 5), _mm_set1_epi16(0x3f));
+        __m128i b = _mm_and_si128(p, _mm_set1_epi16(0x1f));
+
+        r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+        b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+
+        /* 16 bit lanes: r | g << 8 and b */
+        __m128i rg = _mm_or_si128(r, _mm_slli_epi16(g, 8));
+
+        *lo = _mm_unpacklo_epi16(rg, b);
+        *hi = _mm_unpackhi_epi16(rg, b);
+}
+
+
+__attribute__ ((target("ssse3")))
+static void _rgb565_rgb_ssse3(uint8_t * d, const uint8_t * s, size_t n)
+{
+        /* R,G,B,0 -> R,G,B */
+        __m128i mask = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14,
+                                     -1, -1, -1, -1);
+
+        size_t i;
+        /* 8 pixels per iteration, last store writes 4 bytes too many */
+        for(i = 0; i + 10 <= n; i += 8, d += 24, s += 16)
+        {
+                __m128i lo, hi;
+                _565_expand_ssse3(s, &lo, &hi);
+                _mm_storeu_si128((__m128i *) d, _mm_shuffle_epi8(lo, mask));
+                _mm_storeu_si128((__m128i *) (d + 12),
+                                 _mm_shuffle_epi8(hi, mask));
+        }
+
+        _rgb565_rgb(d, s, n - i);
+}
+
+
+__attribute__ ((target("ssse3")))
+static void _bgr_rgb_ssse3(uint8_t * d, const uint8_t * s, size_t n)
+{
+        __m128i mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9,
+                                     14, 13, 12, -1);
+
+        size_t i;
+        /* 5 pixels per iteration, load & store touch 1 byte more */
+        for(i = 0; i + 6 <= n; i += 5, d += 15, s += 15)
+        {
+                __m128i v = _mm_loadu_si128((const __m128i *) s);
+                _mm_storeu_si128((__m128i *) d, _mm_shuffle_epi8(v, mask));
+        }
+
+        _bgr_rgb(d, s, n - i);
+}
+
+
+__attribute__ ((target("ssse3")))
+static void _x2rgb10_rgb16_ssse3(uint8_t * d, const uint8_t * s, size_t n)
+{
+        __m128i m10 = _mm_set1_epi32(0x3ff);
+        /* R,G,B,X of 16 bit -> R,G,B */
+        __m128i mask = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 8, 9, 10, 11, 12, 13,
+                                     -1, -1, -1, -1);
+
+        size_t i;
+        /* 4 pixels per iteration, last store writes 4 bytes too many */
+        for(i = 0; i + 5 <= n; i += 4, d += 24, s += 16)
+        {
+                __m128i p = _mm_loadu_si128((const __m128i *) s);
+                __m128i r = _mm_and_si128(_mm_srli_epi32(p, 20), m10);
+                __m128i g = _mm_and_si128(_mm_srli_epi32(p, 10), m10);
+                __m128i b = _mm_and_si128(p, m10);
+
+                r = _mm_or_si128(_mm_slli_epi32(r, 6), _mm_srli_epi32(r, 4));
+                g = _mm_or_si128(_mm_slli_epi32(g, 6), _mm_srli_epi32(g, 4));
+                b = _mm_or_si128(_mm_slli_epi32(b, 6), _mm_srli_epi32(b, 4));
+
+                /* 32 bit lanes: r | g << 16 and b */
+                __m128i rg = _mm_or_si128(r, _mm_slli_epi32(g, 16));
+
+                _mm_storeu_si128((__m128i *) d,
+                                 _mm_shuffle_epi8(_mm_unpacklo_epi32(rg, b),
+                                                  mask));
+                _mm_storeu_si128((__m128i *) (d + 12),
+                                 _mm_shuffle_epi8(_mm_unpackhi_epi32(rg, b),
+                                                  mask));
+        }
+
+        _x2rgb10_rgb16(d, s, n - i);
+}
+
+
+static const ConvertImpl _ssse3 = {
+        .name = "ssse3",
+        .kernels = {
+                    [CONVERT_BGRX_RGB] = _bgrx_rgb_ssse3,
+                    [CONVERT_XRGB_RGB] = _xrgb_rgb_ssse3,
+                    [CONVERT_BSWAP32] = _bswap32_ssse3,
+                    [CONVERT_RGB565_RGB] = _rgb565_rgb_ssse3,
+                    [CONVERT_BGR_RGB] = _bgr_rgb_ssse3,
+                    [CONVERT_X2RGB10_RGB16] = _x2rgb10_rgb16_ssse3,
+                    },
+};
+
+
+
+/******************************************************************************
+ * AVX2
+ ******************************************************************************/
+
+/** 8 pixels of 32 bit to 24 bit per iteration */
+__attribute__ ((target("avx2")))
+static size_t _shuffle24_avx2(uint8_t * d, const uint8_t * s, size_t n,
+                              __m256i mask)
+{
+        /* move 12 bytes of upper lane next to the ones of the lower lane */
+        __m256i pack = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+        size_t i;
+        /* every store writes 8 bytes more than it converted */
+        for(i = 0; i + 11 <= n; i += 8, d += 24, s += 32)
+        {
+                __m256i v = _mm256_loadu_si256((const __m256i *) s);
+                v = _mm256_shuffle_epi8(v, mask);
+                _mm256_storeu_si256((__m256i *) d,
+                                    _mm256_permutevar8x32_epi32(v, pack));
+        }
+
+        return i;
+}
+
+
+__attribute__ ((target("avx2")))
+static void _bgrx_rgb_avx2(uint8_t * d, const uint8_t * s, size_t n)
+{
+        size_t i = _shuffle24_avx2(d, s, n,
+                                   _mm256_setr_epi8(SHUF_BGRX_RGB,
+                                                    SHUF_BGRX_RGB));
+        _bgrx_rgb_ssse3(d + i * 3, s + i * 4, n - i);
+}
+
+
+__attribute__ ((target("avx2")))
+static void _xrgb_rgb_avx2(uint8_t * d, const uint8_t * s, size_t n)
+{
+        size_t i = _shuffle24_avx2(d, s, n,
+                                   _mm256_setr_epi8(SHUF_XRGB_RGB,
+                                                    SHUF_XRGB_RGB));
+        _xrgb_rgb_ssse3(d + i * 3, s + i * 4, n - i);
+}
+
+
+__attribute__ ((target("avx2")))
+static void _bswap32_avx2(uint8_t * d, const uint8_t * s, size_t n)
+{
+        __m256i mask = _mm256_setr_epi8(SHUF_BSWAP32, SHUF_BSWAP32);
+
+        size_t i;
+        for(i = 0; i + 8 <= n; i += 8, d += 32, s += 32)
+        {
+                __m256i v = _mm256_loadu_si256((const __m256i *) s);
+                _mm256_storeu_si256((__m256i *) d,
+                                    _mm256_shuffle_epi8(v, mask));
+        }
+
+        _bswap32_ssse3(d, s, n - i);
+}
+
+
+/** 5:6:5, 24 bit & 10 bit gain little from wider vectors, use SSSE3 kernels */
+static const ConvertImpl _avx2 = {
+        .name = "avx2",
+        .kernels = {
+                    [CONVERT_BGRX_RGB] = _bgrx_rgb_avx2,
+                    [CONVERT_XRGB_RGB] = _xrgb_rgb_avx2,
+                    [CONVERT_BSWAP32] = _bswap32_avx2,
+                    },
+};
+#endif /* CONVERT_X86 */
+
+
+
+#ifdef CONVERT_NEON
+/******************************************************************************
+ * NEON
+ ******************************************************************************/
+
+static void _bgrx_rgb_neon(uint8_t * d, const uint8_t * s, size_t n)
+{
+        size_t i;
+        for(i = 0; i + 16 <= n; i += 16, d += 48, s += 64)
+        {
+                uint8x16x4_t v = vld4q_u8(s);
+                uint8x16x3_t o = {{v.val[2], v.val[1], v.val[0]}};
+                vst3q_u8(d, o);
+        }
+
+        _bgrx_rgb(d, s, n - i);
+}
+
+
+static void _xrgb_rgb_neon(uint8_t * d, const uint8_t * s, size_t n)
+{
+        size_t i;
+        for(i = 0; i + 16 <= n; i += 16, d += 48, s += 64)
+        {
+                uint8x16x4_t v = vld4q_u8(s);
+                uint8x16x3_t o = {{v.val[1], v.val[2], v.val[3]}};
+                vst3q_u8(d, o);
+        }
+
+        _xrgb_rgb(d, s, n - i);
+}
+
+
+static void _bswap32_neon(uint8_t * d, const uint8_t * s, size_t n)
+{
+        size_t i;
+        for(i = 0; i + 4 <= n; i += 4, d += 16, s += 16)
+                vst1q_u8(d, vrev32q_u8(vld1q_u8(s)));
+
+        _bswap32(d, s, n - i);
+}
+
+
+static void _rgb565_rgb_neon(uint8_t * d, const uint8_t * s, size_t n)
+{
+        size_t i;
+        for(i = 0; i + 8 <= n; i += 8, d += 24, s += 16)
+        {
+                uint16x8_t p = vld1q_u16((const uint16_t *) s);
+                uint8x8_t r = vmovn_u16(vshrq_n_u16(p, 11));
+                uint8x8_t g = vmovn_u16(vandq_u16(vshrq_n_u16(p, 5),
+                                                  vdupq_n_u16(0x3f)));
+                uint8x8_t b = vmovn_u16(vandq_u16(p, vdupq_n_u16(0x1f)));
+
+                uint8x8x3_t o;
+                o.val[0] = vorr_u8(vshl_n_u8(r, 3), vshr_n_u8(r, 2));
+                o.val[1] = vorr_u8(vshl_n_u8(g, 2), vshr_n_u8(g, 4));
+                o.val[2] = vorr_u8(vshl_n_u8(b, 3), vshr_n_u8(b, 2));
+                vst3_u8(d, o);
+        }
+
+        _rgb565_rgb(d, s, n - i);
+}
+
+
+static void _bgr_rgb_neon(uint8_t * d, const uint8_t * s, size_t n)
+{
+        size_t i;
+        for(i = 0; i + 16 <= n; i += 16, d += 48, s += 48)
+        {
+                uint8x16x3_t v = vld3q_u8(s);
+                uint8x16x3_t o = {{v.val[2], v.val[1], v.val[0]}};
+                vst3q_u8(d, o);
+        }
+
+        _bgr_rgb(d, s, n - i);
+}
+
+
+static const ConvertImpl _neon = {
+        .name = "neon",
+        .kernels = {
+                    [CONVERT_BGRX_RGB] = _bgrx_rgb_neon,
+                    [CONVERT_XRGB_RGB] = _xrgb_rgb_neon,
+                    [CONVERT_BSWAP32] = _bswap32_neon,
+                    [CONVERT_RGB565_RGB] = _rgb565_rgb_neon,
+                    [CONVERT_BGR_RGB] = _bgr_rgb_neon,
+                    },
+};
+#endif /* CONVERT_NEON */
+
+
+
+/******************************************************************************/
+
+/** use kernels of impl where it has one */
+static void _select(const ConvertImpl * impl)
+{
+        int k;
+        for(k = CONVERT_NONE + 1; k < CONVERT_MAX; k++)
+        {
+                if(!impl->kernels[k])
+                        continue;
+
+                _c.kernels[k] = impl->kernels[k];
+                _c.names[k] = impl->name;
+        }
+}
+
+
+#ifdef DEBUG
+/** compare selected kernels against scalar reference */
+static void _selftest()
+{
+        /* odd amount of pixels to cover all tails */
+        const size_t n = 1021;
+        const size_t size = n * 6 + 32;
+        uint8_t *src = malloc(n * 4), *ref = malloc(size), *out = malloc(size);
+        if(!src || !ref || !out)
+                goto _s_exit;
+
+        size_t i;
+        for(i = 0; i < n * 4; i++)
+                src[i] = (i * 2654435761u) >> 13;
+
+        int k;
+        for(k = CONVERT_NONE + 1; k < CONVERT_MAX; k++)
+        {
+                if(_c.kernels[k] == _scalar.kernels[k])
+                        continue;
+
+                /* every size up to n, so each tail length is checked */
+                size_t len, bytes = k == CONVERT_BSWAP32 ? 4 :
+                        (k == CONVERT_X2RGB10_RGB16 ? 6 : 3);
+                for(len = 0; len <= n; len += len < 64 ? 1 : 97)
+                {
+                        memset(ref, 0xaa, size);
+                        memset(out, 0xaa, size);
+                        _scalar.kernels[k] (ref, src, len);
+                        _c.kernels[k] (out, src, len);
+
+                        if(memcmp(ref, out, size) != 0)
+                        {
+                                NFT_LOG(L_ERROR,
+                                        "%s kernel %d differs from scalar "
+                                        "for %zu pixels (%zu bytes), disabled",
+                                        _c.names[k], k, len, len * bytes);
+                                _c.kernels[k] = _scalar.kernels[k];
+                                _c.names[k] = _scalar.name;
+                                break;
+                        }
+                }
+        }
+
+_s_exit:
+        free(src);
+        free(ref);
+        free(out);
+}
+#endif /* DEBUG */
+
+
+/**
+ * select fastest kernels for this CPU (safe to call more than once)
+ */
+void convert_init()
+{
+        if(_c.initialized)
+                return;
+
+        _select(&_scalar);
+
+#ifdef CONVERT_X86
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("ssse3"))
+                _select(&_ssse3);
+        if(__builtin_cpu_supports("avx2"))
+                _select(&_avx2);
+#endif /* CONVERT_X86 */
+
+#ifdef CONVERT_NEON
+        _select(&_neon);
+#endif /* CONVERT_NEON */
+
+#ifdef DEBUG
+        _selftest();
+#endif /* DEBUG */
+
+        _c.initialized = true;
+}
+
+
+/**
+ * find conversion of captured frames to a format that's cheaper to map
+ *
+ * @param format pixel-format delivered by capture mechanism
+ * @param big_endian byte-order delivered by capture mechanism
+ * @param target space for pixel-format after conversion
+ * @result conversion or CONVERT_NONE
+ */
+ConvertKernel convert_kernel(const char *format, bool big_endian,
+                             const char **target)
+{
+        if(!format || !target)
+                NFT_LOG_NULL(CONVERT_NONE);
+
+        *target = format;
+
+        /* 32 bit pixels as delivered by X visuals */
+        if(strcmp(format, "ARGB u8") == 0)
+        {
+                *target = "RGB u8";
+                return big_endian ? CONVERT_BGRX_RGB : CONVERT_XRGB_RGB;
+        }
+
+        /* 5:6:5 visuals */
+        if(strcmp(format, "RGB 565") == 0)
+        {
+                *target = "RGB u8";
+                return CONVERT_RGB565_RGB;
+        }
+
+        /* other 32 bit formats in swapped byte-order */
+        LedPixelFormat *f = led_pixel_format_from_string(format);
+        if(big_endian && f && led_pixel_format_get_bytes_per_pixel(f) == 4 &&
+           led_pixel_format_get_n_components(f) == 4)
+                return CONVERT_BSWAP32;
+
+        return CONVERT_NONE;
+}
+
+
+/**
+ * name of implementation used for conversion
+ */
+const char *convert_implementation(ConvertKernel k)
+{
+        if(k <= CONVERT_NONE || k >= CONVERT_MAX || !_c.names[k])
+                return "none";
+
+        return _c.names[k];
+}
+
+
+/**
+ * convert pixels
+ *
+ * @param k conversion
+ * @param dst space for converted pixels
+ * @param src pixels to convert
+ * @param pixels amount of pixels
+ */
+void convert_run(ConvertKernel k, uint8_t * dst, const uint8_t * src,
+                 size_t pixels)
+{
+        _c.kernels[k] (dst, src, pixels);
+}
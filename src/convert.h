@@ -0,0 +1,78 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _CONVERT_H
+#define _CONVERT_H
+
+#include <stdint.h>
+
+
+/** pixel conversions ledcap can do itself */
+typedef enum
+{
+        /** no conversion needed/possible */
+        CONVERT_NONE = 0,
+        /** 32 bit B,G,R,X in memory to R,G,B */
+        CONVERT_BGRX_RGB,
+        /** 32 bit X,R,G,B in memory to R,G,B */
+        CONVERT_XRGB_RGB,
+        /** reverse byte-order of 32 bit pixels */
+        CONVERT_BSWAP32,
+        /** 16 bit 5:6:5 RGB in host byte-order to R,G,B */
+        CONVERT_RGB565_RGB,
+        /** 24 bit B,G,R in memory to R,G,B */
+        CONVERT_BGR_RGB,
+        /** 32 bit 2:10:10:10 RGB in host byte-order to R,G,B u16 */
+        CONVERT_X2RGB10_RGB16,
+        CONVERT_MAX,
+} ConvertKernel;
+
+
+void                            convert_init();
+ConvertKernel                   convert_kernel(const char *format, bool big_endian, const char **target);
+const char                     *convert_implementation(ConvertKernel k);
+void                            convert_run(ConvertKernel k, uint8_t * dst, const uint8_t * src, size_t pixels);
+
+
+
+#endif /** _CONVERT_H */
@@ -0,0 +1,213 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * convert-test - check every SIMD conversion kernel against the scalar one
+ *
+ * All implementations the CPU supports are tested (not only the selected
+ * ones), for every tail length up to a few vector widths and with source
+ * & destination at every alignment. Bytes beyond the converted pixels
+ * must stay untouched. Run by "make check".
+ */
+
+/* test the private kernels directly */
+#include "convert.c"
+
+
+/** maximum amount of pixels converted */
+#define TEST_PIXELS 1021
+/** misalignments tested for source & destination */
+#define TEST_OFFSETS 4
+/** guard bytes behind destination */
+#define TEST_GUARD 64
+
+
+/** bytes per source pixel of kernel */
+static size_t _src_bytes(ConvertKernel k)
+{
+        switch (k)
+        {
+                case CONVERT_RGB565_RGB:
+                        return 2;
+                case CONVERT_BGR_RGB:
+                        return 3;
+                default:
+                        return 4;
+        }
+}
+
+
+/** bytes per destination pixel of kernel */
+static size_t _dst_bytes(ConvertKernel k)
+{
+        switch (k)
+        {
+                case CONVERT_BSWAP32:
+                        return 4;
+                case CONVERT_X2RGB10_RGB16:
+                        return 6;
+                default:
+                        return 3;
+        }
+}
+
+
+/** compare all kernels of impl against scalar reference */
+static int _test(const ConvertImpl * impl, const uint8_t * src, uint8_t * ref,
+                 uint8_t * out, size_t size)
+{
+        int failures = 0;
+
+        int k;
+        for(k = CONVERT_NONE + 1; k < CONVERT_MAX; k++)
+        {
+                if(!impl->kernels[k])
+                        continue;
+
+                size_t len, tested = 0;
+                for(len = 0; len <= TEST_PIXELS; len += len < 96 ? 1 : 37)
+                {
+                        size_t so, doff;
+                        for(so = 0; so < TEST_OFFSETS; so++)
+                        {
+                                for(doff = 0; doff < TEST_OFFSETS; doff++)
+                                {
+                                        memset(ref, 0xaa, size);
+                                        memset(out, 0xaa, size);
+                                        _scalar.kernels[k] (ref + doff,
+                                                            src + so, len);
+                                        impl->kernels[k] (out + doff,
+                                                          src + so, len);
+                                        tested++;
+
+                                        if(memcmp(ref, out, size) == 0)
+                                                continue;
+
+                                        printf("FAIL: %s kernel %d, %zu pixels, src+%zu, dst+%zu\n",
+                                               impl->name, k, len, so, doff);
+                                        failures++;
+                                        /* one report per kernel is enough */
+                                        goto _t_next;
+                                }
+                        }
+                }
+
+                printf("ok: %s kernel %d (%zu runs, %zu -> %zu bytes/pixel)\n",
+                       impl->name, k, tested, _src_bytes(k), _dst_bytes(k));
+_t_next:
+                ;
+        }
+
+        return failures;
+}
+
+
+int main()
+{
+        int res = EXIT_FAILURE;
+
+        size_t size = TEST_PIXELS * 6 + TEST_OFFSETS + TEST_GUARD;
+        uint8_t *src = malloc(TEST_PIXELS * 4 + TEST_OFFSETS);
+        uint8_t *ref = malloc(size), *out = malloc(size);
+        if(!src || !ref || !out)
+        {
+                perror("malloc()");
+                goto _m_exit;
+        }
+
+        /* every bit pattern shows up in every byte position */
+        size_t i;
+        for(i = 0; i < TEST_PIXELS * 4 + TEST_OFFSETS; i++)
+                src[i] = (i * 2654435761u) >> 13;
+
+        /* implementations this CPU can run */
+        const ConvertImpl *impls[3];
+        int n = 0;
+
+#ifdef CONVERT_X86
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("ssse3"))
+                impls[n++] = &_ssse3;
+        else
+                printf("skip: ssse3 (not supported by CPU)\n");
+
+        if(__builtin_cpu_supports("avx2"))
+                impls[n++] = &_avx2;
+        else
+                printf("skip: avx2 (not supported by CPU)\n");
+#endif /* CONVERT_X86 */
+
+#ifdef CONVERT_NEON
+        impls[n++] = &_neon;
+#endif /* CONVERT_NEON */
+
+        int failures = 0, j;
+        for(j = 0; j < n; j++)
+                failures += _test(impls[j], src, ref, out, size);
+
+        /* selected kernels must produce the same as well */
+        convert_init();
+        for(i = CONVERT_NONE + 1; i < CONVERT_MAX; i++)
+        {
+                memset(ref, 0xaa, size);
+                memset(out, 0xaa, size);
+                _scalar.kernels[i] (ref, src, TEST_PIXELS);
+                convert_run(i, out, src, TEST_PIXELS);
+                if(memcmp(ref, out, size) != 0)
+                {
+                        printf("FAIL: selected kernel %zu (%s)\n", i,
+                               convert_implementation(i));
+                        failures++;
+                }
+        }
+
+        if(!failures)
+                res = EXIT_SUCCESS;
+
+_m_exit:
+        free(src);
+        free(ref);
+        free(out);
+
+        return res;
+}
@@ -0,0 +1,264 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * track damaged portions of the screen using the XDamage extension, so
+ * only changed parts of the capture rectangle need to be captured
+ */
+
+#include "config.h"
+
+#ifdef HAVE_XDAMAGE
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xfixes.h>
+#include <X11/extensions/Xdamage.h>
+#include <niftyled.h>
+#include "capture.h"
+#include "damage.h"
+
+
+
+/** private structure to hold info accros function-calls */
+static struct
+{
+        Display *display;
+        /** event base of damage extension */
+        int event_base;
+        /** damage object of root window */
+        Damage damage;
+        /** server-side region used to fetch damaged rectangles */
+        XserverRegion region;
+        /** true if damage was reported since last damage_get() */
+        bool damaged;
+        /** true until the whole area was returned once */
+        bool initial;
+        /** capture rectangle (screen coordinates) */
+        CaptureRect rect;
+} _c;
+
+
+
+#ifndef MIN
+#define MIN(a,b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a,b) (((a) > (b)) ? (a) : (b))
+#endif
+
+
+/**
+ * grow rectangle a to also cover rectangle b
+ */
+static void _union(CaptureRect * a, CaptureRect * b)
+{
+        LedFrameCord x2 = MAX(a->x + a->w, b->x + b->w);
+        LedFrameCord y2 = MAX(a->y + a->h, b->y + b->h);
+
+        a->x = MIN(a->x, b->x);
+        a->y = MIN(a->y, b->y);
+        a->w = x2 - a->x;
+        a->h = y2 - a->y;
+}
+
+
+/**
+ * clip screen rectangle r to capture rectangle and convert to frame
+ * coordinates. Returns false if r doesn't intersect capture rectangle
+ */
+static bool _clip(XRectangle * r, CaptureRect * result)
+{
+        LedFrameCord x1 = MAX(r->x, _c.rect.x);
+        LedFrameCord y1 = MAX(r->y, _c.rect.y);
+        LedFrameCord x2 = MIN(r->x + r->width, _c.rect.x + _c.rect.w);
+        LedFrameCord y2 = MIN(r->y + r->height, _c.rect.y + _c.rect.h);
+
+        if(x2 <= x1 || y2 <= y1)
+                return false;
+
+        result->x = x1 - _c.rect.x;
+        result->y = y1 - _c.rect.y;
+        result->w = x2 - x1;
+        result->h = y2 - y1;
+
+        return true;
+}
+
+
+/**
+ * get rectangles (relative to capture rectangle) that changed since the last
+ * call. n will be set to 0 if nothing changed. The first call returns the
+ * whole capture rectangle.
+ *
+ * @param rects array of DAMAGE_RECTS_MAX rectangles
+ * @param n amount of rectangles written to rects
+ */
+NftResult damage_get(CaptureRect * rects, size_t * n)
+{
+        if(!rects || !n)
+                NFT_LOG_NULL(NFT_FAILURE);
+
+        *n = 0;
+
+        /* collect pending damage notifications */
+        while(XPending(_c.display))
+        {
+                XEvent ev;
+                XNextEvent(_c.display, &ev);
+                if(ev.type == _c.event_base + XDamageNotify)
+                        _c.damaged = true;
+        }
+
+        if(!_c.damaged)
+                return NFT_SUCCESS;
+
+        _c.damaged = false;
+
+        /* move damage to our region */
+        XDamageSubtract(_c.display, _c.damage, None, _c.region);
+
+        /* initially, capture whole area */
+        if(_c.initial)
+        {
+                rects[0].x = 0;
+                rects[0].y = 0;
+                rects[0].w = _c.rect.w;
+                rects[0].h = _c.rect.h;
+                *n = 1;
+                _c.initial = false;
+                return NFT_SUCCESS;
+        }
+
+        /* fetch damaged rectangles */
+        XRectangle *xrects;
+        int count = 0;
+        xrects = XFixesFetchRegion(_c.display, _c.region, &count);
+
+        int i;
+        for(i = 0; xrects && i < count; i++)
+        {
+                CaptureRect r;
+                if(!_clip(&xrects[i], &r))
+                        continue;
+
+                /* too many rectangles? merge all into bounding box */
+                if(*n >= DAMAGE_RECTS_MAX)
+                {
+                        size_t j;
+                        for(j = 1; j < *n; j++)
+                                _union(&r, &rects[j]);
+                        _union(&rects[0], &r);
+                        *n = 1;
+                        continue;
+                }
+
+                rects[(*n)++] = r;
+        }
+
+        if(xrects)
+                XFree(xrects);
+
+        NFT_LOG(L_DEBUG, "%d damaged rectangles, %zu to capture",
+                count, *n);
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * start tracking damage of capture rectangle (in screen coordinates)
+ */
+NftResult damage_init(LedFrameCord x, LedFrameCord y, LedFrameCord w,
+                      LedFrameCord h)
+{
+        if(!(_c.display = XOpenDisplay(NULL)))
+        {
+                NFT_LOG(L_ERROR, "Can't open X display.");
+                return NFT_FAILURE;
+        }
+
+        int error_base;
+        if(!XDamageQueryExtension(_c.display, &_c.event_base, &error_base))
+        {
+                NFT_LOG(L_ERROR, "X server doesn't support DAMAGE extension");
+                goto _di_error;
+        }
+
+        _c.damage = XDamageCreate(_c.display, DefaultRootWindow(_c.display),
+                                  XDamageReportNonEmpty);
+        _c.region = XFixesCreateRegion(_c.display, NULL, 0);
+
+        _c.rect.x = x;
+        _c.rect.y = y;
+        _c.rect.w = w;
+        _c.rect.h = h;
+
+        /* initially, whole area needs to be captured */
+        _c.damaged = true;
+        _c.initial = true;
+
+        return NFT_SUCCESS;
+
+_di_error:
+        XCloseDisplay(_c.display);
+        _c.display = NULL;
+        return NFT_FAILURE;
+}
+
+
+/**
+ * stop tracking damage
+ */
+void damage_deinit()
+{
+        if(!_c.display)
+                return;
+
+        XFixesDestroyRegion(_c.display, _c.region);
+        XDamageDestroy(_c.display, _c.damage);
+        XCloseDisplay(_c.display);
+        _c.display = NULL;
+}
+
+
+#endif /* HAVE_XDAMAGE */
@@ -47,15 +47,35 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <signal.h>
 #include <getopt.h>
 
 #include <niftyled.h>
 #include "capture.h"
+#include "damage.h"
+#include "sparse.h"
+#include "pipeline.h"
+#include "output.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "metrics.h"
+#include "shmring.h"
+#include "convert.h"
+#include "scale.h"
+#include "region.h"
+#include "letterbox.h"
 #include "version.h"
 
 
 
+/** maximum amount of --option arguments */
+#define OPTIONS_MAX 16
+/** slots of shared-memory ring captured frames are published to */
+#define PUBLISH_SLOTS 4
+
+
+
 /**
  * @todo make mechanism selectable
  * @todo print list of mechanisms with --help
@@ -81,6 +101,44 @@ static struct
         LedFrameCord width;
         /** input frame height (in pixels) */
         LedFrameCord height;
+        /** position of grabbed rectangle (covers all regions) */
+        LedFrameCord gx, gy;
+        /** only capture damaged parts of the screen */
+        bool incremental;
+        /** only capture pixels that are mapped to LEDs */
+        bool sparse;
+        /** average captured frames down to dimensions of LED-setup */
+        bool downscale;
+        /** only capture content between static black borders */
+        bool letterbox;
+        /** true if current frame is captured completely for analysis */
+        bool probing;
+        /** amount of frames for pipelined mode (0 = not pipelined) */
+        int pipeline;
+        /** drop frames in pipelined mode so only the latest one is used */
+        bool latest;
+        /** amount of threads to serve hardware with (0 = sequential) */
+        int parallel;
+        /** how frames are paced */
+        SchedulePolicy schedule;
+        /** unix socket to serve metrics on (empty = disabled) */
+        char metrics[108];
+        /** options for capture mechanism */
+        struct
+        {
+                const char *key;
+                const char *value;
+        } options[OPTIONS_MAX];
+        /** amount of options */
+        int n_options;
+        /** name of shared-memory ring to publish frames to (empty = off) */
+        char publish[256];
+        /** ring captured frames are published to */
+        ShmRing *ring;
+        /** conversion of captured frames */
+        ConvertKernel convert;
+        /** frame as captured (only used when converting or downscaling) */
+        LedFrame *raw;
 } _c;
 
 
@@ -96,12 +154,26 @@ static void _print_help(char *name)
                "Valid options:\n"
                "\t--help\t\t\t-h\t\tThis help text\n"
                "\t--mechanism <name>\t-m <name>\tCapture mechanism (default: \"Xlib\")\n"
+               "\t--option <k>=<v>\t-o <k>=<v>\tSet option of capture mechanism (e.g. -o pattern=noise)\n"
                "\t--plugin-help\t\t-p\t\tList of installed plugins + information\n"
                "\t--config <file>\t\t-c <file>\tLoad this config file (default: ~/.ledcat.xml) \n"
                "\t--x <x>\t\t\t-x <x>\t\tX-coordinate of capture rectangle (default: 0)\n"
                "\t--y <y>\t\t\t-y <y>\t\tY-coordinate of capture rectangle (default: 0)\n"
                "\t--dimensions <w>x<h>\t-d <w>x<h>\tDefine width and height of capture rectangle. (default: auto)\n"
                "\t--fps <n>\t\t-f <n>\t\tFramerate to play multiple frames at (default: 25)\n"
+#ifdef HAVE_XDAMAGE
+               "\t--incremental\t\t-i\t\tOnly capture parts of the screen that changed\n"
+#endif /* HAVE_XDAMAGE */
+               "\t--sparse\t\t-s\t\tOnly capture pixels that are mapped to LEDs\n"
+               "\t--downscale\t\t-D\t\tAverage captured frames down to dimensions of LED-setup\n"
+               "\t--letterbox\t\t-B\t\tCrop black borders of captured frames (needs --downscale)\n"
+               "\t--pipeline <n>\t\t-P <n>\t\tCapture, map & output in parallel using <n> frames (default: off)\n"
+               "\t--latest\t\t-L\t\tIn pipelined mode, always use the latest captured frame\n"
+               "\t--parallel <n>\t\t-j <n>\t\tMap & send to multiple hardware using <n> threads (default: off)\n"
+               "\t--schedule <policy>\t-S <policy>\tFrame pacing: relative, skip or catchup (default: relative)\n"
+               "\t--metrics <socket>\t-M <socket>\tServe metrics on this unix socket (default: off)\n"
+               "\t--publish <name>\t-O <name>\tPublish captured frames to this shared-memory ring (default: off)\n"
+               "\t--region <spec>\t\t-R <spec>\tAlso drive setup of <configfile> from region [<display>@]<x>,<y>,<w>x<h>:<configfile>\n"
                "\t--loglevel <level>\t-l <level>\tOnly show messages with loglevel <level> (default: info)\n\n",
                PACKAGE_URL, name);
 
@@ -129,11 +201,25 @@ static NftResult _parse_args(int argc, char *argv[])
                 {"dimensions", required_argument, 0, 'd'},
                 {"fps", required_argument, 0, 'f'},
                 {"mechanism", required_argument, 0, 'm'},
+                {"option", required_argument, 0, 'o'},
+#ifdef HAVE_XDAMAGE
+                {"incremental", 0, 0, 'i'},
+#endif /* HAVE_XDAMAGE */
+                {"sparse", 0, 0, 's'},
+                {"downscale", 0, 0, 'D'},
+                {"letterbox", 0, 0, 'B'},
+                {"pipeline", required_argument, 0, 'P'},
+                {"latest", 0, 0, 'L'},
+                {"parallel", required_argument, 0, 'j'},
+                {"schedule", required_argument, 0, 'S'},
+                {"metrics", required_argument, 0, 'M'},
+                {"publish", required_argument, 0, 'O'},
+                {"region", required_argument, 0, 'R'},
                 {0, 0, 0, 0}
         };
 
         while((argument =
-               getopt_long(argc, argv, "hpl:c:x:y:d:f:m:", loptions,
+               getopt_long(argc, argv, "hpl:c:x:y:d:f:m:o:isDBP:Lj:S:M:O:R:", loptions,
                            &index)) >= 0)
         {
 
@@ -161,6 +247,34 @@ static NftResult _parse_args(int argc, char *argv[])
                                 break;
                         }
 
+                        /* --option */
+                        case 'o':
+                        {
+                                char *value;
+                                if(!(value = strchr(optarg, '=')))
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Invalid option \"%s\" (Use <key>=<value>)",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+
+                                if(_c.n_options >= OPTIONS_MAX)
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Too many options (max. %d)",
+                                                OPTIONS_MAX);
+                                        return NFT_FAILURE;
+                                }
+
+                                /* split argument into key & value */
+                                *value++ = '\0';
+                                _c.options[_c.n_options].key = optarg;
+                                _c.options[_c.n_options].value = value;
+                                _c.n_options++;
+                                break;
+                        }
+
                         /* --config */
                         case 'c':
                         {
@@ -225,6 +339,122 @@ static NftResult _parse_args(int argc, char *argv[])
                                 break;
                         }
 
+#ifdef HAVE_XDAMAGE
+                        /* --incremental */
+                        case 'i':
+                        {
+                                _c.incremental = true;
+                                break;
+                        }
+#endif /* HAVE_XDAMAGE */
+
+                        /* --sparse */
+                        case 's':
+                        {
+                                _c.sparse = true;
+                                break;
+                        }
+
+                        /* --downscale */
+                        case 'D':
+                        {
+                                _c.downscale = true;
+                                break;
+                        }
+
+                        /* --letterbox */
+                        case 'B':
+                        {
+                                _c.letterbox = true;
+                                break;
+                        }
+
+                        /* --pipeline */
+                        case 'P':
+                        {
+                                if(sscanf(optarg, "%32d", &_c.pipeline) != 1
+                                   || _c.pipeline < 0)
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Invalid amount of frames \"%s\" (Use a positive integer)",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+                                break;
+                        }
+
+                        /* --latest */
+                        case 'L':
+                        {
+                                _c.latest = true;
+                                break;
+                        }
+
+                        /* --parallel */
+                        case 'j':
+                        {
+                                if(sscanf(optarg, "%32d", &_c.parallel) != 1
+                                   || _c.parallel < 0)
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Invalid amount of threads \"%s\" (Use a positive integer)",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+                                break;
+                        }
+
+                        /* --schedule */
+                        case 'S':
+                        {
+                                if((int) (_c.schedule =
+                                          scheduler_policy_from_string
+                                          (optarg)) < 0)
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Invalid schedule policy \"%s\" (Use relative, skip or catchup)",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+                                break;
+                        }
+
+                        /* --metrics */
+                        case 'M':
+                        {
+                                if(strlen(optarg) >= sizeof(_c.metrics))
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Socket path \"%s\" too long",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+                                strcpy(_c.metrics, optarg);
+                                break;
+                        }
+
+                        /* --publish */
+                        case 'O':
+                        {
+                                if(strlen(optarg) >= sizeof(_c.publish))
+                                {
+                                        NFT_LOG(L_ERROR,
+                                                "Ring name \"%s\" too long",
+                                                optarg);
+                                        return NFT_FAILURE;
+                                }
+                                strcpy(_c.publish, optarg);
+                                break;
+                        }
+
+                        /* --region */
+                        case 'R':
+                        {
+                                if(!region_add(optarg))
+                                        return NFT_FAILURE;
+                                break;
+                        }
+
                         /* --loglevel */
                         case 'l':
                         {
@@ -271,6 +501,156 @@ void _exit_signal_handler(int signal)
 }
 
 
+/** signal handler to print statistics */
+void _stats_signal_handler(int signal)
+{
+        stats_request_dump();
+}
+
+
+
+/**
+ * capture next frame. changed will be set to false if the frame didn't
+ * change since the last call
+ */
+static NftResult _capture_frame(LedFrame * frame, bool * changed)
+{
+        *changed = true;
+
+#ifdef HAVE_XDAMAGE
+        if(_c.incremental)
+        {
+                /* only capture what changed */
+                CaptureRect damaged[DAMAGE_RECTS_MAX];
+                size_t n;
+                if(!damage_get(damaged, &n))
+                        return NFT_FAILURE;
+
+                /* ... and is sampled by LEDs */
+                CaptureRect clipped[DAMAGE_RECTS_MAX * SPARSE_RECTS_MAX];
+                CaptureRect *rects = damaged;
+                if(_c.sparse)
+                {
+                        n = sparse_clip(damaged, n, clipped,
+                                        DAMAGE_RECTS_MAX * SPARSE_RECTS_MAX);
+                        rects = clipped;
+                }
+
+                if(!(*changed = (n > 0)))
+                        return NFT_SUCCESS;
+
+                return capture_frame_regions(frame, _c.x, _c.y, rects, n);
+        }
+#endif /* HAVE_XDAMAGE */
+
+        /* only capture content between black borders (all of it now and
+           then to notice when they change) */
+        if(_c.letterbox)
+        {
+                if((_c.probing = letterbox_due()))
+                        return capture_frame(frame, _c.x, _c.y);
+
+                CaptureRect r = *letterbox_rect();
+                return capture_frame_regions(frame, _c.x, _c.y, &r, 1);
+        }
+
+        /* only capture what is sampled by LEDs */
+        if(_c.sparse)
+        {
+                size_t n;
+                CaptureRect *rects = sparse_rects(&n);
+                return capture_frame_regions(frame, _c.x, _c.y, rects, n);
+        }
+
+        /* pick up frame requested during last tick */
+        if(!(capture_collect(frame)))
+                return NFT_FAILURE;
+
+        /* request next frame while this one is processed */
+        return capture_request(frame, _c.gx, _c.gy);
+}
+
+
+
+/**
+ * analyze completely captured frames for black borders & prepare
+ * downscaling of the content between them when they moved
+ *
+ * @result first pixel of content (NULL upon error)
+ */
+static const uint8_t *_letterbox(const uint8_t * src, size_t bpp,
+                                 size_t stride, LedFrameCord w, LedFrameCord h)
+{
+        const CaptureRect *r = letterbox_rect();
+
+        if(_c.probing && letterbox_analyze(src))
+        {
+                scale_deinit();
+                if(!scale_init(r->w, r->h, w, h, bpp))
+                        return NULL;
+        }
+
+        return src + r->y * stride + r->x * bpp;
+}
+
+
+/**
+ * capture next frame, convert it & publish it to other consumers
+ */
+static NftResult _capture(LedFrame * frame, bool * changed)
+{
+        if(!_capture_frame(_c.raw ? _c.raw : frame, changed))
+                return NFT_FAILURE;
+
+        /* cut our rectangle out of the one covering all regions */
+        if(_c.raw && *changed && region_count())
+        {
+                region_crop(frame, _c.raw, _c.x - _c.gx, _c.y - _c.gy,
+                            _c.convert);
+        }
+        else if(_c.raw && *changed)
+        {
+                const uint8_t *src = led_frame_get_buffer(_c.raw);
+
+                LedFrameCord w, h, rw, rh;
+                led_frame_get_dim(frame, &w, &h);
+                led_frame_get_dim(_c.raw, &rw, &rh);
+                size_t bpp = led_pixel_format_get_bytes_per_pixel
+                        (led_frame_get_format(_c.raw));
+
+                /* skip black borders */
+                if(_c.letterbox &&
+                   !(src = _letterbox(src, bpp, rw * bpp, w, h)))
+                        return NFT_FAILURE;
+
+                /* reduce to dimensions of LED-setup */
+                if(_c.downscale)
+                        src = scale_run(src, rw * bpp);
+                if(_c.convert)
+                        convert_run(_c.convert, led_frame_get_buffer(frame),
+                                    src, w * h);
+                else
+                        memcpy(led_frame_get_buffer(frame), src,
+                               led_frame_get_buffersize(frame));
+        }
+
+        if(_c.ring && *changed)
+                shmring_publish(_c.ring, led_frame_get_buffer(frame));
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * capture function for pipelined mode
+ */
+static NftResult _pipeline_capture(LedFrame * frame)
+{
+        bool changed;
+        return _capture(frame, &changed);
+}
+
+
 
 /******************************************************************************/
 /******************************************************************************/
@@ -314,6 +694,13 @@ int main(int argc, char *argv[])
                 }
         }
 
+        /* print statistics on SIGUSR1 */
+        if(signal(SIGUSR1, _stats_signal_handler) == SIG_ERR)
+        {
+                NFT_LOG_PERROR("signal()");
+                goto _m_exit;
+        }
+
 
 
         /* default fps */
@@ -404,6 +791,38 @@ int main(int argc, char *argv[])
                 goto _m_exit;
         }
 
+        /* every pipelined frame would only hold its own damage */
+        if(_c.incremental && _c.pipeline)
+        {
+                NFT_LOG(L_ERROR,
+                        "Incremental capture can't be used in pipelined mode");
+                goto _m_exit;
+        }
+
+        /* averaging needs every pixel of the capture rectangle */
+        if(_c.sparse && _c.downscale)
+        {
+                NFT_LOG(L_ERROR,
+                        "Sparse capture can't be used when downscaling");
+                goto _m_exit;
+        }
+
+        /* borders are only cropped by downscaling */
+        if(_c.letterbox && (!_c.downscale || _c.pipeline || _c.incremental))
+        {
+                NFT_LOG(L_ERROR,
+                        "Letterbox detection needs --downscale and can't be used with pipelined or incremental capture");
+                goto _m_exit;
+        }
+
+        /* other consumers would get frames that are only partly captured */
+        if(_c.sparse && _c.publish[0])
+        {
+                NFT_LOG(L_ERROR,
+                        "Sparse capture can't be used when publishing frames");
+                goto _m_exit;
+        }
+
         /* sanitize x-offset @todo check for maximum */
         if(_c.x < 0)
         {
@@ -419,21 +838,109 @@ int main(int argc, char *argv[])
         }
 
 
+        /* grab rectangle covering all regions */
+        _c.gx = _c.x;
+        _c.gy = _c.y;
+        LedFrameCord gw = _c.width, gh = _c.height;
+        if(region_count())
+        {
+                if(_c.pipeline || _c.sparse || _c.incremental || _c.downscale)
+                {
+                        NFT_LOG(L_ERROR,
+                                "Regions can't be used with pipelined, sparse, incremental or downscaled capture");
+                        goto _m_exit;
+                }
+
+                if(!region_init(prefs))
+                        goto _m_exit;
+
+                region_bounds(&_c.gx, &_c.gy, &gw, &gh);
+
+                NFT_LOG(L_INFO, "Grabbing %dx%d at %d/%d for %d regions",
+                        gw, gh, _c.gx, _c.gy, region_count() + 1);
+        }
+
+
+        /* pass options to capture mechanism */
+        int o;
+        for(o = 0; o < _c.n_options; o++)
+        {
+                if(!capture_option(_c.method, _c.options[o].key,
+                                   _c.options[o].value))
+                        goto _m_exit;
+        }
+
         /* initialize capture mechanism (only imlib for now) */
         if(!capture_init(_c.method))
                 goto _m_exit;
 
+        /* convert captured frames ourselves where that's cheaper (not when
+           only a few rectangles are captured, converting the whole frame
+           would eat up what sparse/incremental capture saves) */
+        const char *format = capture_format();
+        if(!_c.sparse && !_c.incremental &&
+           (_c.convert = convert_kernel(capture_format(),
+                                        capture_is_big_endian(), &format)))
+        {
+                NFT_LOG(L_VERBOSE, "Converting %s to %s (%s)",
+                        capture_format(), format,
+                        convert_implementation(_c.convert));
+        }
+
+        /* capture into separate frame that's converted/downscaled/cut */
+        if(_c.convert || _c.downscale || region_count())
+        {
+                if(!(_c.raw = led_frame_new(gw, gh,
+                                            led_pixel_format_from_string
+                                            (capture_format()))))
+                        goto _m_exit;
+
+                led_frame_set_big_endian(_c.raw, capture_is_big_endian());
+        }
+
+        /* frame LEDs are mapped from is as large as the setup */
+        if(!_c.downscale)
+        {
+                width = _c.width;
+                height = _c.height;
+        }
+
         /* allocate framebuffer */
-        NFT_LOG(L_INFO, "Allocating frame: %dx%d (%s)",
-                _c.width, _c.height, capture_format());
+        NFT_LOG(L_INFO, "Allocating frame: %dx%d (%s)", width, height,
+                format);
         if(!
            (frame =
-            led_frame_new(_c.width, _c.height,
-                          led_pixel_format_from_string(capture_format()))))
+            led_frame_new(width, height,
+                          led_pixel_format_from_string(format))))
                 goto _m_exit;
 
-        /* respect endianness */
-        led_frame_set_big_endian(frame, capture_is_big_endian());
+        /* average captured frames down to frame */
+        if(_c.downscale)
+        {
+                LedPixelFormat *f = led_frame_get_format(_c.raw);
+                if(led_pixel_format_get_bytes_per_pixel(f) !=
+                   led_pixel_format_get_n_components(f))
+                {
+                        NFT_LOG(L_ERROR,
+                                "Can't downscale \"%s\" (only 8 bits per component)",
+                                capture_format());
+                        goto _m_exit;
+                }
+
+                if(!scale_init(_c.width, _c.height, width, height,
+                               led_pixel_format_get_bytes_per_pixel(f)))
+                        goto _m_exit;
+
+                /* follow black borders of captured frames */
+                if(_c.letterbox &&
+                   !letterbox_init(_c.width, _c.height, capture_format(),
+                                   capture_is_big_endian(), width, height))
+                        goto _m_exit;
+        }
+
+        /* respect endianness (only conversion puts pixels in format order) */
+        led_frame_set_big_endian(frame, _c.convert ? false :
+                                 capture_is_big_endian());
 
         /* get first hardware */
         LedHardware *hw;
@@ -452,14 +959,47 @@ int main(int argc, char *argv[])
         if(!led_hardware_list_refresh_gain(hw))
                 goto _m_exit;
 
+        /* map chains of other regions */
+        if(region_count() &&
+           !region_map(format, led_frame_get_big_endian(frame), _c.convert))
+                goto _m_exit;
+
+
+        /* prepare mapping & sending to hardware */
+        if(!output_init(hw, _c.parallel))
+                goto _m_exit;
+
 
         /* print some debug-info */
         led_frame_print(frame, L_VERBOSE);
         led_hardware_print(hw, L_VERBOSE);
 
 
-        /* initially sample time for frametiming */
-        if(!led_fps_sample())
+#ifdef HAVE_XDAMAGE
+        /* start tracking changes of capture rectangle */
+        if(_c.incremental &&
+           !damage_init(_c.x, _c.y, _c.width, _c.height))
+                goto _m_exit;
+#endif /* HAVE_XDAMAGE */
+
+
+        /* only capture pixels that are mapped to LEDs */
+        if(_c.sparse && !sparse_init(hw, frame))
+                goto _m_exit;
+
+        /* share captured frames with other consumers */
+        if(_c.publish[0] &&
+           !(_c.ring = shmring_create(_c.publish, width, height,
+                                      format,
+                                      led_pixel_format_get_bytes_per_pixel
+                                      (led_frame_get_format(frame)),
+                                      led_frame_get_big_endian(frame),
+                                      PUBLISH_SLOTS)))
+                goto _m_exit;
+
+        /* request first frame */
+        if(!_c.incremental && !_c.sparse && !_c.letterbox &&
+           !capture_request(_c.raw ? _c.raw : frame, _c.gx, _c.gy))
                 goto _m_exit;
 
 
@@ -467,56 +1007,137 @@ int main(int argc, char *argv[])
         NFT_LOG(L_INFO, "Capturing %dx%d pixels at position x/y: %d/%d",
                 _c.width, _c.height, _c.x, _c.y);
 
+        /* start frametiming */
+        if(!scheduler_init(_c.fps, _c.schedule))
+                goto _m_exit;
+
+        /* serve metrics */
+        if(_c.metrics[0] &&
+           !metrics_init(_c.metrics, capture_method_to_string(_c.method),
+                         _c.x, _c.y, _c.width, _c.height))
+                goto _m_exit;
+
         /* loop until _c.running is set to false */
         _c.running = true;
-        while(_c.running)
+
+        /* run stages in parallel */
+        if(_c.pipeline)
         {
+                if(!pipeline_run(hw, frame, _c.pipeline, _c.latest,
+                                 _pipeline_capture, &_c.running))
+                        goto _m_exit;
+        }
+
+        while(_c.running && !_c.pipeline)
+        {
+                /* let regions on other displays capture in parallel */
+                region_start();
+
                 /* capture frame */
-                if(!(capture_frame(frame, _c.x, _c.y)))
+                bool changed;
+                long long t = stats_now();
+                if(!_capture(frame, &changed))
                         break;
+                stats_record(STAGE_CAPTURE, t);
 
                 /* print frame for debugging */
                 // led_frame_buffer_print(frame);
 
-                /* map from frame */
-                LedHardware *h;
-                for(h = hw; h; h = led_hardware_list_get_next(h))
+                if(changed)
                 {
-                        if(!led_chain_fill_from_frame
-                           (led_hardware_get_chain(h), frame))
-                        {
-                                NFT_LOG(L_ERROR, "Error while mapping frame");
+                        /* map from frame */
+                        t = stats_now();
+                        output_run(frame, OUTPUT_FILL);
+                        if(region_count())
+                                region_output(_c.raw, _c.gx, _c.gy,
+                                              OUTPUT_FILL);
+                        stats_record(STAGE_FILL, t);
+
+                        /* send frame to hardware(s) */
+                        t = stats_now();
+                        output_run(frame, OUTPUT_SEND);
+                        if(region_count())
+                                region_output(_c.raw, _c.gx, _c.gy,
+                                              OUTPUT_SEND);
+
+                        /* regions on other displays sent theirs, too */
+                        if(!region_wait())
+                                break;
+                        stats_record(STAGE_SEND, t);
+                }
+                else
+                {
+                        /* a failed region ends the main-loop like capturing */
+                        if(!region_wait())
                                 break;
-                        }
                 }
 
-
-                /* send frame to hardware(s) */
-                led_hardware_list_send(hw);
-
-                /* delay in respect to fps */
-                if(!led_fps_delay(_c.fps))
+                /* wait until frame is due */
+                t = stats_now();
+                if(!scheduler_wait())
                         break;
+                stats_record(STAGE_DELAY, t);
 
                 /* show frame */
-                led_hardware_list_show(hw);
+                if(changed)
+                {
+                        t = stats_now();
+                        led_hardware_list_show(hw);
+                        region_show();
+                        stats_record(STAGE_SHOW, t);
+                }
 
                 /* save time when frame is displayed */
-                if(!led_fps_sample())
+                if(!scheduler_shown())
                         break;
+
+                /* print statistics if requested */
+                stats_poll();
+                metrics_poll();
         }
 
+        /* print timing statistics */
+        scheduler_report(L_INFO);
+        stats_print(L_INFO);
 
 
         /* mark success */
         res = EXIT_SUCCESS;
 
 _m_exit:
+        /* stop serving metrics */
+        metrics_deinit();
+
+#ifdef HAVE_XDAMAGE
+        /* stop tracking damage */
+        if(_c.incremental)
+                damage_deinit();
+#endif /* HAVE_XDAMAGE */
+
+        /* free sparse capture regions */
+        sparse_deinit();
+
+        /* free downscaling buffers */
+        scale_deinit();
+
+        /* free letterbox detection */
+        letterbox_deinit();
+
+        /* remove shared-memory ring */
+        shmring_close(_c.ring);
+
+        /* stop output threads */
+        output_deinit();
+
         /* deinitialize capture mechanism */
         capture_deinit();
 
+        /* free other regions */
+        region_deinit();
+
         /* free frame */
         led_frame_destroy(frame);
+        led_frame_destroy(_c.raw);
 
         /* destroy config */
         led_setup_destroy(setup);
@@ -0,0 +1,330 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * detection of static black borders (letterbox/pillarbox)
+ *
+ * Every LETTERBOX_INTERVAL frames a whole frame is analyzed: luminance of
+ * every row & column is summed up and the first/last rows & columns that
+ * aren't black bound the content. The active rectangle is the union of
+ * the content of the last LETTERBOX_WINDOW analyzed frames, so it only
+ * shrinks once borders were static in all of them but grows as soon as
+ * content shows up in a border. Completely black frames (fades, scene
+ * cuts) are ignored.
+ *
+ * Luminance is approximated by the sum of all components (without
+ * alpha/padding).
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <niftyled.h>
+#include "letterbox.h"
+
+
+/** mean component value rows & columns must exceed to not be black */
+#define LETTERBOX_BLACK 8
+
+
+/** private structure to hold info accros function-calls */
+static struct
+{
+        /** dimensions of analyzed frames */
+        LedFrameCord w, h;
+        /** minimum dimensions of active rectangle */
+        LedFrameCord min_w, min_h;
+        /** bytes per pixel */
+        size_t bpp;
+        /** byte of pixel that is ignored (alpha/padding, -1 = none) */
+        int skip;
+        /** luminance sums of rows & columns */
+        uint64_t *rows, *cols;
+        /** content of last analyzed frames */
+        CaptureRect window[LETTERBOX_WINDOW];
+        /** amount of valid entries in window */
+        int n;
+        /** next entry of window to be replaced */
+        int next;
+        /** frames since last analysis */
+        int frames;
+        /** currently active rectangle */
+        CaptureRect active;
+} _c;
+
+
+
+/** bound content of sums (first & last sum > black) */
+static bool _bounds(const uint64_t * sums, LedFrameCord n, uint64_t black,
+                    LedFrameCord * first, LedFrameCord * length)
+{
+        LedFrameCord a, b;
+        for(a = 0; a < n && sums[a] <= black; a++);
+
+        if(a == n)
+                return false;
+
+        for(b = n - 1; sums[b] <= black; b--);
+
+        *first = a;
+        *length = b - a + 1;
+        return true;
+}
+
+
+/** grow span to minimum length (keeping it centered & inside 0..n) */
+static void _widen(LedFrameCord * first, LedFrameCord * length,
+                   LedFrameCord min, LedFrameCord n)
+{
+        if(*length >= min)
+                return;
+
+        *first -= (min - *length) / 2;
+        *length = min;
+
+        if(*first < 0)
+                *first = 0;
+        if(*first + *length > n)
+                *first = n - *length;
+}
+
+
+/** smallest rectangle covering a & b */
+static CaptureRect _union(const CaptureRect * a, const CaptureRect * b)
+{
+        CaptureRect r;
+        r.x = a->x < b->x ? a->x : b->x;
+        r.y = a->y < b->y ? a->y : b->y;
+        LedFrameCord ax = a->x + a->w, bx = b->x + b->w;
+        LedFrameCord ay = a->y + a->h, by = b->y + b->h;
+        r.w = (ax > bx ? ax : bx) - r.x;
+        r.h = (ay > by ? ay : by) - r.y;
+        return r;
+}
+
+
+/** true if a lies within b */
+static bool _inside(const CaptureRect * a, const CaptureRect * b)
+{
+        return a->x >= b->x && a->y >= b->y &&
+                a->x + a->w <= b->x + b->w && a->y + a->h <= b->y + b->h;
+}
+
+
+/**
+ * prepare detection
+ *
+ * @param w width of analyzed frames
+ * @param h height of analyzed frames
+ * @param format pixelformat of analyzed frames (8 bits per component)
+ * @param big_endian true if components are stored in reverse order
+ * @param min_w active rectangle is never narrower than this
+ * @param min_h active rectangle is never lower than this
+ */
+NftResult letterbox_init(LedFrameCord w, LedFrameCord h, const char *format,
+                         bool big_endian, LedFrameCord min_w,
+                         LedFrameCord min_h)
+{
+        LedPixelFormat *f;
+        if(!(f = led_pixel_format_from_string(format)))
+                return NFT_FAILURE;
+
+        _c.w = w;
+        _c.h = h;
+        _c.min_w = min_w < w ? min_w : w;
+        _c.min_h = min_h < h ? min_h : h;
+        _c.bpp = led_pixel_format_get_bytes_per_pixel(f);
+
+        /* 4th component is alpha or padding */
+        _c.skip = -1;
+        if(_c.bpp == 4)
+        {
+                int c;
+                for(c = 0; c < 4; c++)
+                {
+                        if(format[c] == 'A' || format[c] == 'X')
+                                _c.skip = big_endian ? 3 - c : c;
+                }
+        }
+
+        if(!(_c.rows = calloc(h, sizeof(uint64_t))) ||
+           !(_c.cols = calloc(w, sizeof(uint64_t))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                letterbox_deinit();
+                return NFT_FAILURE;
+        }
+
+        _c.active.x = 0;
+        _c.active.y = 0;
+        _c.active.w = w;
+        _c.active.h = h;
+        _c.n = 0;
+        _c.next = 0;
+        _c.frames = 0;
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * free resources of detection
+ */
+void letterbox_deinit()
+{
+        free(_c.rows);
+        _c.rows = NULL;
+        free(_c.cols);
+        _c.cols = NULL;
+}
+
+
+/**
+ * count frame
+ *
+ * @result true if this frame should be captured completely & analyzed
+ */
+bool letterbox_due()
+{
+        if(_c.frames-- > 0)
+                return false;
+
+        _c.frames = LETTERBOX_INTERVAL - 1;
+        return true;
+}
+
+
+/**
+ * analyze complete frame & update active rectangle
+ *
+ * @param buf w * h pixels
+ * @result true if active rectangle changed
+ */
+bool letterbox_analyze(const uint8_t * buf)
+{
+        memset(_c.cols, 0, _c.w * sizeof(uint64_t));
+
+        LedFrameCord x, y;
+        for(y = 0; y < _c.h; y++)
+        {
+                const uint8_t *p = buf + (size_t) y * _c.w * _c.bpp;
+                uint64_t row = 0;
+                for(x = 0; x < _c.w; x++, p += _c.bpp)
+                {
+                        unsigned int sum = 0;
+                        size_t c;
+                        for(c = 0; c < _c.bpp; c++)
+                                sum += p[c];
+                        if(_c.skip >= 0)
+                                sum -= p[_c.skip];
+
+                        _c.cols[x] += sum;
+                        row += sum;
+                }
+                _c.rows[y] = row;
+        }
+
+        size_t components = _c.skip >= 0 ? _c.bpp - 1 : _c.bpp;
+        CaptureRect content;
+        if(!_bounds(_c.rows, _c.h, (uint64_t) LETTERBOX_BLACK * components *
+                    _c.w, &content.y, &content.h) ||
+           !_bounds(_c.cols, _c.w, (uint64_t) LETTERBOX_BLACK * components *
+                    _c.h, &content.x, &content.w))
+        {
+                /* black frame, nothing to learn from */
+                return false;
+        }
+
+        _widen(&content.x, &content.w, _c.min_w, _c.w);
+        _widen(&content.y, &content.h, _c.min_h, _c.h);
+
+        _c.window[_c.next] = content;
+        _c.next = (_c.next + 1) % LETTERBOX_WINDOW;
+        if(_c.n < LETTERBOX_WINDOW)
+                _c.n++;
+
+        CaptureRect r;
+        if(!_inside(&content, &_c.active))
+        {
+                /* grow at once so no content is cut */
+                r = _union(&content, &_c.active);
+        }
+        else
+        {
+                /* shrink only after borders were static for a while and
+                   changed noticeably (1/32 of the frame) */
+                if(_c.n < LETTERBOX_WINDOW)
+                        return false;
+
+                r = content;
+                int i;
+                for(i = 0; i < _c.n; i++)
+                        r = _union(&r, &_c.window[i]);
+
+                if(r.x - _c.active.x < _c.w / 32 &&
+                   _c.active.x + _c.active.w - r.x - r.w < _c.w / 32 &&
+                   r.y - _c.active.y < _c.h / 32 &&
+                   _c.active.y + _c.active.h - r.y - r.h < _c.h / 32)
+                        return false;
+        }
+
+        if(memcmp(&r, &_c.active, sizeof(r)) == 0)
+                return false;
+
+        _c.active = r;
+
+        NFT_LOG(L_VERBOSE, "Active rectangle: %dx%d at %d/%d", r.w, r.h,
+                r.x, r.y);
+
+        return true;
+}
+
+
+/**
+ * current active rectangle (relative to analyzed frames)
+ */
+const CaptureRect *letterbox_rect()
+{
+        return &_c.active;
+}
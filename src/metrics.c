@@ -0,0 +1,308 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * serve a snapshot of counters in prometheus text format on a unix socket.
+ *
+ * The listening socket is non-blocking and polled once per frame. Every
+ * client that connected since the last poll gets the current snapshot and
+ * is disconnected right away, so a client that doesn't read can't stall
+ * the main-loop (it will just receive a truncated snapshot). Read it e.g.
+ * with "socat - UNIX-CONNECT:<socket>".
+ */
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <niftyled.h>
+#include "capture.h"
+#include "pipeline.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "metrics.h"
+
+
+/** maximum amount of clients served per poll */
+#define METRICS_CLIENTS_MAX 4
+/** maximum size of one snapshot */
+#define METRICS_BUFSIZE 4096
+
+
+/** private structure to hold info accros function-calls */
+static struct
+{
+        /** listening socket (-1 if metrics are disabled) */
+        int fd;
+        /** path of socket */
+        struct sockaddr_un addr;
+        /** name of capture mechanism */
+        const char *mechanism;
+        /** capture rectangle */
+        CaptureRect rect;
+        /** snapshot buffer */
+        char buf[METRICS_BUFSIZE];
+        /** bytes used in buffer */
+        size_t len;
+} _c = {.fd = -1 };
+
+
+
+/** append to snapshot */
+static void _printf(const char *fmt, ...)
+{
+        if(_c.len >= sizeof(_c.buf))
+                return;
+
+        va_list ap;
+        va_start(ap, fmt);
+        int n = vsnprintf(_c.buf + _c.len, sizeof(_c.buf) - _c.len, fmt, ap);
+        va_end(ap);
+
+        if(n > 0)
+                _c.len += n;
+}
+
+
+/** append metric with help & type */
+static void _metric(const char *name, const char *type, const char *help)
+{
+        _printf("# HELP ledcap_%s %s\n# TYPE ledcap_%s %s\n",
+                name, help, name, type);
+}
+
+
+/** build current snapshot */
+static void _snapshot()
+{
+        _c.len = 0;
+
+        unsigned long long captured, sent;
+        long long sum;
+        stats_total(STAGE_CAPTURE, &captured, &sum);
+        stats_total(STAGE_SEND, &sent, &sum);
+
+        _metric("frames_captured_total", "counter", "Frames captured");
+        _printf("ledcap_frames_captured_total %llu\n", captured);
+
+        _metric("frames_sent_total", "counter", "Frames sent to hardware");
+        _printf("ledcap_frames_sent_total %llu\n", sent);
+
+        _metric("capture_failures_total", "counter", "Failed captures");
+        _printf("ledcap_capture_failures_total %lu\n", capture_failures());
+
+        _metric("frames_dropped_total", "counter",
+                "Captured frames dropped by pipeline before being used");
+        _printf("ledcap_frames_dropped_total %lu\n", pipeline_dropped());
+
+        _metric("deadlines_missed_total", "counter",
+                "Frames that were shown after their deadline");
+        _printf("ledcap_deadlines_missed_total %lu\n", scheduler_overruns());
+
+        _metric("deadlines_skipped_total", "counter",
+                "Deadlines skipped to catch up");
+        _printf("ledcap_deadlines_skipped_total %lu\n", scheduler_skipped());
+
+        _metric("fps", "gauge", "Framerate achieved during the last frames");
+        _printf("ledcap_fps %.3f\n", scheduler_fps());
+
+        _metric("stage_seconds_total", "counter",
+                "Time spent in stage of main-loop");
+        int s;
+        for(s = 0; s < STAGE_MAX; s++)
+        {
+                unsigned long long count;
+                stats_total(s, &count, &sum);
+                _printf("ledcap_stage_seconds_total{stage=\"%s\"} %.9f\n",
+                        stats_stage_name(s), sum / 1e9);
+        }
+
+        _metric("stage_runs_total", "counter", "Runs of stage of main-loop");
+        for(s = 0; s < STAGE_MAX; s++)
+        {
+                unsigned long long count;
+                stats_total(s, &count, &sum);
+                _printf("ledcap_stage_runs_total{stage=\"%s\"} %llu\n",
+                        stats_stage_name(s), count);
+        }
+
+        _metric("capture_info", "gauge", "Capture mechanism and rectangle");
+        _printf("ledcap_capture_info{mechanism=\"%s\",x=\"%d\",y=\"%d\","
+                "width=\"%d\",height=\"%d\"} 1\n", _c.mechanism,
+                _c.rect.x, _c.rect.y, _c.rect.w, _c.rect.h);
+}
+
+
+/**
+ * start listening for metric requests
+ *
+ * @param path filename of unix socket
+ * @param mechanism name of capture mechanism
+ * @param x x-offset of capture rectangle
+ * @param y y-offset of capture rectangle
+ * @param w width of capture rectangle
+ * @param h height of capture rectangle
+ */
+NftResult metrics_init(const char *path, const char *mechanism,
+                       LedFrameCord x, LedFrameCord y,
+                       LedFrameCord w, LedFrameCord h)
+{
+        if(!path || !mechanism)
+                NFT_LOG_NULL(NFT_FAILURE);
+
+        if(strlen(path) >= sizeof(_c.addr.sun_path))
+        {
+                NFT_LOG(L_ERROR, "Socket path \"%s\" too long", path);
+                return NFT_FAILURE;
+        }
+
+        _c.mechanism = mechanism;
+        _c.rect.x = x;
+        _c.rect.y = y;
+        _c.rect.w = w;
+        _c.rect.h = h;
+
+        memset(&_c.addr, 0, sizeof(_c.addr));
+        _c.addr.sun_family = AF_UNIX;
+        strcpy(_c.addr.sun_path, path);
+
+        /* remove stale socket of previous instance */
+        struct stat st;
+        if(lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+                unlink(path);
+
+        if((_c.fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+        {
+                NFT_LOG_PERROR("socket()");
+                return NFT_FAILURE;
+        }
+
+        /* accept() must never block the main-loop */
+        if(fcntl(_c.fd, F_SETFL, O_NONBLOCK) < 0 ||
+           fcntl(_c.fd, F_SETFD, FD_CLOEXEC) < 0)
+        {
+                NFT_LOG_PERROR("fcntl()");
+                goto _mi_error;
+        }
+
+        if(bind(_c.fd, (struct sockaddr *) &_c.addr, sizeof(_c.addr)) < 0)
+        {
+                NFT_LOG_PERROR("bind()");
+                goto _mi_error;
+        }
+
+        if(listen(_c.fd, METRICS_CLIENTS_MAX) < 0)
+        {
+                NFT_LOG_PERROR("listen()");
+                unlink(_c.addr.sun_path);
+                goto _mi_error;
+        }
+
+        NFT_LOG(L_INFO, "Serving metrics on \"%s\"", path);
+
+        return NFT_SUCCESS;
+
+_mi_error:
+        close(_c.fd);
+        _c.fd = -1;
+        return NFT_FAILURE;
+}
+
+
+/**
+ * stop listening & remove socket
+ */
+void metrics_deinit()
+{
+        if(_c.fd < 0)
+                return;
+
+        close(_c.fd);
+        _c.fd = -1;
+        unlink(_c.addr.sun_path);
+}
+
+
+/**
+ * answer pending requests. Call regularly from main-loop, never blocks
+ */
+void metrics_poll()
+{
+        if(_c.fd < 0)
+                return;
+
+        bool built = false;
+
+        int i;
+        for(i = 0; i < METRICS_CLIENTS_MAX; i++)
+        {
+                int client;
+                if((client = accept(_c.fd, NULL, NULL)) < 0)
+                {
+                        if(errno != EAGAIN && errno != EWOULDBLOCK &&
+                           errno != EINTR)
+                                NFT_LOG_PERROR("accept()");
+                        return;
+                }
+
+                /* only build snapshot if someone asks for it */
+                if(!built)
+                {
+                        _snapshot();
+                        built = true;
+                }
+
+                /* send whatever fits into the socket buffer */
+                if(send(client, _c.buf, _c.len,
+                        MSG_DONTWAIT | MSG_NOSIGNAL) < 0)
+                        NFT_LOG(L_DEBUG, "send(): %s", strerror(errno));
+
+                close(client);
+        }
+}
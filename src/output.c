@@ -0,0 +1,318 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * fill chains from frame & send them to the hardware. With workers, every
+ * hardware is processed by one thread of a pool, so multiple controllers
+ * are served in parallel. output_run() returns when all hardware is done,
+ * so all controllers can be latched at the same time afterwards.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <niftyled.h>
+#include "output.h"
+
+
+
+/** one thread of the pool */
+typedef struct
+{
+        /** index of this worker */
+        int index;
+        /** thread handle */
+        pthread_t thread;
+        /** result of last job */
+        NftResult result;
+} Worker;
+
+
+/** private structure to hold info accros function-calls */
+static struct
+{
+        /** first hardware in list */
+        LedHardware *hw;
+        /** all hardware in list */
+        LedHardware **hws;
+        /** amount of hardware in list */
+        int count;
+        /** worker threads (NULL if we work sequentially) */
+        Worker *workers;
+        /** amount of worker threads */
+        int n;
+        /** protects job state below */
+        pthread_mutex_t mutex;
+        /** signalled when a new job is available */
+        pthread_cond_t start;
+        /** signalled when the last worker finished its job */
+        pthread_cond_t done;
+        /** incremented for every job */
+        unsigned long generation;
+        /** amount of workers still busy with current job */
+        int busy;
+        /** frame of current job */
+        LedFrame *frame;
+        /** current job */
+        OutputJob jobs;
+        /** true when workers should exit */
+        bool quit;
+} _c;
+
+
+
+/** process one hardware */
+static NftResult _process(LedHardware * h, LedFrame * frame, OutputJob jobs)
+{
+        if(jobs & OUTPUT_FILL)
+        {
+                if(!led_chain_fill_from_frame(led_hardware_get_chain(h), frame))
+                {
+                        NFT_LOG(L_ERROR, "Error while mapping frame");
+                        return NFT_FAILURE;
+                }
+        }
+
+        if(jobs & OUTPUT_SEND)
+        {
+                if(!led_hardware_send(h))
+                {
+                        NFT_LOG(L_ERROR, "Error while sending frame");
+                        return NFT_FAILURE;
+                }
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/** worker thread */
+static void *_worker(void *arg)
+{
+        Worker *w = arg;
+        unsigned long generation = 0;
+
+        pthread_mutex_lock(&_c.mutex);
+        while(true)
+        {
+                /* wait for job */
+                while(_c.generation == generation)
+                        pthread_cond_wait(&_c.start, &_c.mutex);
+                generation = _c.generation;
+
+                if(_c.quit)
+                        break;
+
+                pthread_mutex_unlock(&_c.mutex);
+
+                /* process our share of hardware */
+                w->result = NFT_SUCCESS;
+                int i;
+                for(i = w->index; i < _c.count; i += _c.n)
+                {
+                        if(!_process(_c.hws[i], _c.frame, _c.jobs))
+                                w->result = NFT_FAILURE;
+                }
+
+                /* job done */
+                pthread_mutex_lock(&_c.mutex);
+                if(--_c.busy == 0)
+                        pthread_cond_signal(&_c.done);
+        }
+        pthread_mutex_unlock(&_c.mutex);
+
+        return NULL;
+}
+
+
+/**
+ * fill chains of all hardware from frame and/or send them
+ */
+NftResult output_run(LedFrame * frame, OutputJob jobs)
+{
+        /* sequential mode */
+        if(!_c.workers)
+        {
+                NftResult r = NFT_SUCCESS;
+
+                if(jobs & OUTPUT_FILL)
+                {
+                        LedHardware *h;
+                        for(h = _c.hw; h; h = led_hardware_list_get_next(h))
+                        {
+                                if(!_process(h, frame, OUTPUT_FILL))
+                                {
+                                        r = NFT_FAILURE;
+                                        break;
+                                }
+                        }
+                }
+
+                if(jobs & OUTPUT_SEND)
+                        led_hardware_list_send(_c.hw);
+
+                return r;
+        }
+
+        /* start workers & wait until all of them are done */
+        pthread_mutex_lock(&_c.mutex);
+        _c.frame = frame;
+        _c.jobs = jobs;
+        _c.busy = _c.n;
+        _c.generation++;
+        pthread_cond_broadcast(&_c.start);
+        while(_c.busy > 0)
+                pthread_cond_wait(&_c.done, &_c.mutex);
+        pthread_mutex_unlock(&_c.mutex);
+
+        int i;
+        for(i = 0; i < _c.n; i++)
+        {
+                if(!_c.workers[i].result)
+                        return NFT_FAILURE;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * initialize output for hardware list
+ *
+ * @param hw first hardware in list
+ * @param workers amount of threads (0 = process hardware sequentially)
+ */
+NftResult output_init(LedHardware * hw, int workers)
+{
+        if(!hw)
+                NFT_LOG_NULL(NFT_FAILURE);
+
+        _c.hw = hw;
+        _c.workers = NULL;
+        _c.quit = false;
+
+        if(workers <= 0)
+                return NFT_SUCCESS;
+
+        /* collect hardware */
+        LedHardware *h;
+        for(_c.count = 0, h = hw; h; h = led_hardware_list_get_next(h))
+                _c.count++;
+
+        if(!(_c.hws = calloc(_c.count, sizeof(LedHardware *))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NFT_FAILURE;
+        }
+
+        int i;
+        for(i = 0, h = hw; h; h = led_hardware_list_get_next(h))
+                _c.hws[i++] = h;
+
+        /* more threads than hardware would idle */
+        _c.n = workers < _c.count ? workers : _c.count;
+
+        if(!(_c.workers = calloc(_c.n, sizeof(Worker))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                goto _oi_error;
+        }
+
+        pthread_mutex_init(&_c.mutex, NULL);
+        pthread_cond_init(&_c.start, NULL);
+        pthread_cond_init(&_c.done, NULL);
+        _c.generation = 0;
+
+        for(i = 0; i < _c.n; i++)
+        {
+                _c.workers[i].index = i;
+                if(pthread_create(&_c.workers[i].thread, NULL, _worker,
+                                  &_c.workers[i]) != 0)
+                {
+                        NFT_LOG_PERROR("pthread_create()");
+                        /* only started workers take part from now on */
+                        _c.n = i;
+                        output_deinit();
+                        return NFT_FAILURE;
+                }
+        }
+
+        NFT_LOG(L_INFO, "Serving %d hardware(s) with %d threads", _c.count,
+                _c.n);
+
+        return NFT_SUCCESS;
+
+_oi_error:
+        free(_c.hws);
+        _c.hws = NULL;
+        return NFT_FAILURE;
+}
+
+
+/**
+ * stop workers
+ */
+void output_deinit()
+{
+        if(_c.workers)
+        {
+                /* let workers exit */
+                pthread_mutex_lock(&_c.mutex);
+                _c.quit = true;
+                _c.generation++;
+                pthread_cond_broadcast(&_c.start);
+                pthread_mutex_unlock(&_c.mutex);
+
+                int i;
+                for(i = 0; i < _c.n; i++)
+                        pthread_join(_c.workers[i].thread, NULL);
+
+                pthread_cond_destroy(&_c.start);
+                pthread_cond_destroy(&_c.done);
+                pthread_mutex_destroy(&_c.mutex);
+                free(_c.workers);
+                _c.workers = NULL;
+        }
+
+        free(_c.hws);
+        _c.hws = NULL;
+}
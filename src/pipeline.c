@@ -0,0 +1,303 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * pipelined main-loop: capture, mapping and output run in their own
+ * threads, so the framerate is limited by the slowest stage instead of the
+ * sum of all stages.
+ *
+ * capture thread -> frame ring -> mapping thread -> chains -> output thread
+ *
+ * Mapping and output share the chains of the hardware, so the mapping
+ * thread fills them while the output thread waits for the next frame to be
+ * shown and the output thread sends them while the mapping thread waits for
+ * the next captured frame.
+ */
+
+#include <pthread.h>
+#include <niftyled.h>
+#include "ring.h"
+#include "output.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "metrics.h"
+#include "pipeline.h"
+
+
+
+/** private structure to hold info accros function-calls */
+static struct
+{
+        /** first hardware in list */
+        LedHardware *hw;
+        /** ring between capture & mapping thread */
+        FrameRing *ring;
+        /** function to capture frame */
+        PipelineCaptureFunc capture;
+        /** external running flag */
+        bool *running;
+        /** internal running flag */
+        bool pipeline_running;
+        /** true when chains hold mapped data that wasn't sent, yet */
+        bool filled;
+        /** result of pipeline */
+        NftResult result;
+} _c;
+
+
+
+/** true as long as all stages should keep running */
+static bool _running()
+{
+        return __atomic_load_n(&_c.pipeline_running, __ATOMIC_ACQUIRE) &&
+                __atomic_load_n(_c.running, __ATOMIC_ACQUIRE);
+}
+
+
+/** stop all stages */
+static void _stop(NftResult result)
+{
+        if(!result)
+                _c.result = NFT_FAILURE;
+
+        __atomic_store_n(&_c.pipeline_running, false, __ATOMIC_RELEASE);
+}
+
+
+/** wait until chains reached "filled" state */
+static bool _wait_filled(bool filled)
+{
+        unsigned int n = 0;
+        while(__atomic_load_n(&_c.filled, __ATOMIC_ACQUIRE) != filled)
+        {
+                if(!_running())
+                        return false;
+
+                ring_backoff(&n);
+        }
+
+        return true;
+}
+
+
+/**
+ * capture stage
+ */
+static void *_capture_thread(void *unused)
+{
+        while(_running())
+        {
+                int slot;
+                if((slot = ring_write_acquire(_c.ring,
+                                              &_c.pipeline_running)) < 0)
+                        break;
+
+                long long t = stats_now();
+                if(!_c.capture(ring_frame(_c.ring, slot)))
+                {
+                        _stop(NFT_FAILURE);
+                        break;
+                }
+                stats_record(STAGE_CAPTURE, t);
+
+                ring_write_publish(_c.ring, slot);
+        }
+
+        return NULL;
+}
+
+
+/**
+ * mapping stage
+ */
+static void *_map_thread(void *unused)
+{
+        while(_running())
+        {
+                /* wait until output stage sent previous data, before picking
+                   a frame so the newest one is mapped (with --latest) */
+                if(!_wait_filled(false))
+                        break;
+
+                int slot;
+                if((slot = ring_read_acquire(_c.ring,
+                                             &_c.pipeline_running)) < 0)
+                        break;
+
+                /* map from frame */
+                long long t = stats_now();
+                output_run(ring_frame(_c.ring, slot), OUTPUT_FILL);
+                stats_record(STAGE_FILL, t);
+
+                ring_read_release(_c.ring, slot);
+
+                /* hand chains over to output stage */
+                __atomic_store_n(&_c.filled, true, __ATOMIC_RELEASE);
+        }
+
+        return NULL;
+}
+
+
+/**
+ * output stage
+ */
+static void _output()
+{
+        while(_running())
+        {
+                /* wait for mapped data */
+                if(!_wait_filled(true))
+                        break;
+
+                /* send frame to hardware(s) */
+                long long t = stats_now();
+                output_run(NULL, OUTPUT_SEND);
+                stats_record(STAGE_SEND, t);
+
+                /* hand chains back to mapping stage */
+                __atomic_store_n(&_c.filled, false, __ATOMIC_RELEASE);
+
+                /* wait until frame is due */
+                t = stats_now();
+                if(!scheduler_wait())
+                {
+                        _stop(NFT_FAILURE);
+                        break;
+                }
+                stats_record(STAGE_DELAY, t);
+
+                /* show frame */
+                t = stats_now();
+                led_hardware_list_show(_c.hw);
+                stats_record(STAGE_SHOW, t);
+
+                /* save time when frame is displayed */
+                if(!scheduler_shown())
+                {
+                        _stop(NFT_FAILURE);
+                        break;
+                }
+
+                /* print statistics if requested */
+                stats_poll();
+                metrics_poll();
+        }
+}
+
+
+/**
+ * amount of frames dropped by the pipeline so far
+ */
+unsigned long pipeline_dropped()
+{
+        return _c.ring ? ring_dropped(_c.ring) : 0;
+}
+
+
+/**
+ * run pipelined main-loop until *running becomes false
+ *
+ * @param hw first hardware in list
+ * @param prototype frame used to map chains, ring frames will be created
+ *        with its dimensions & format
+ * @param depth amount of frames in ring
+ * @param latest true to drop frames the mapping stage didn't pick up in time
+ * @param capture function that captures one frame
+ * @param running flag to stop pipeline
+ */
+NftResult pipeline_run(LedHardware * hw, LedFrame * prototype, size_t depth,
+                       bool latest, PipelineCaptureFunc capture,
+                       bool * running)
+{
+        if(!hw || !prototype || !capture || !running)
+                NFT_LOG_NULL(NFT_FAILURE);
+
+        _c.hw = hw;
+        _c.capture = capture;
+        _c.running = running;
+        _c.pipeline_running = true;
+        _c.filled = false;
+        _c.result = NFT_SUCCESS;
+
+        if(!(_c.ring = ring_new(prototype, depth, latest)))
+                return NFT_FAILURE;
+
+        NFT_LOG(L_INFO, "Running pipelined with %zu frames (%s)", depth,
+                latest ? "latest frame wins" : "no frames dropped");
+
+        /* start capture & mapping stage */
+        pthread_t capture_thread, map_thread;
+        if(pthread_create(&capture_thread, NULL, _capture_thread, NULL) != 0)
+        {
+                NFT_LOG_PERROR("pthread_create()");
+                ring_destroy(_c.ring);
+                _c.ring = NULL;
+                return NFT_FAILURE;
+        }
+
+        if(pthread_create(&map_thread, NULL, _map_thread, NULL) != 0)
+        {
+                NFT_LOG_PERROR("pthread_create()");
+                _stop(NFT_FAILURE);
+                pthread_join(capture_thread, NULL);
+                ring_destroy(_c.ring);
+                _c.ring = NULL;
+                return NFT_FAILURE;
+        }
+
+        /* output stage runs in this thread */
+        _output();
+
+        /* stop other stages */
+        _stop(NFT_SUCCESS);
+        pthread_join(capture_thread, NULL);
+        pthread_join(map_thread, NULL);
+
+        NFT_LOG(L_VERBOSE, "%lu frames dropped", ring_dropped(_c.ring));
+
+        ring_destroy(_c.ring);
+        _c.ring = NULL;
+
+        return _c.result;
+}
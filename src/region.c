@@ -0,0 +1,640 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * additional screen regions, each driving its own LED-setup
+ *
+ * All regions are cut out of one grabbed rectangle that covers them (and
+ * the main capture rectangle), so the screen is only captured once per
+ * frame no matter how many setups are driven.
+ *
+ * Regions on other X displays are captured, mapped & sent by one thread
+ * per region while the main rectangle is processed. All hardware is
+ * latched together by region_show(), so every display updates in the same
+ * tick.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <niftyled.h>
+#include "capture.h"
+#include "convert.h"
+#include "output.h"
+#ifdef HAVE_X
+#include "cap_x11.h"
+#endif /* HAVE_X */
+#include "region.h"
+
+
+/** one region */
+typedef struct
+{
+        /** position on screen */
+        LedFrameCord x, y;
+        /** dimensions (raised to dimensions of setup if smaller) */
+        LedFrameCord w, h;
+        /** config file of setup */
+        char prefsfile[1024];
+        /** setup of this region */
+        LedSetup *setup;
+        /** first hardware of setup */
+        LedHardware *hw;
+        /** frame the chains of this region are mapped from */
+        LedFrame *frame;
+        /** X display of region (empty = cut out of grabbed frame) */
+        char display[64];
+#ifdef HAVE_X
+        /** connection to display */
+        X11Display *x11;
+#endif /* HAVE_X */
+        /** frame as captured from display (only used when converting) */
+        LedFrame *raw;
+        /** conversion from raw to frame */
+        ConvertKernel convert;
+        /** thread capturing display */
+        pthread_t thread;
+        /** true if thread was started */
+        bool running;
+        /** result of last tick */
+        NftResult result;
+} Region;
+
+
+/** private structure to hold info accros function-calls */
+static struct
+{
+        /** all regions */
+        Region regions[REGIONS_MAX];
+        /** amount of regions */
+        int n;
+        /** conversion while cutting regions out of grabbed frame */
+        ConvertKernel convert;
+        /** protects everything below */
+        pthread_mutex_t lock;
+        /** signalled when a tick is started or threads should quit */
+        pthread_cond_t start;
+        /** signalled when the last thread finished its tick */
+        pthread_cond_t done;
+        /** incremented for every tick */
+        unsigned long generation;
+        /** amount of threads that didn't finish current tick */
+        int pending;
+        /** amount of threads running */
+        int threads;
+        /** true if threads should exit */
+        bool quit;
+} _c = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .start = PTHREAD_COND_INITIALIZER,
+        .done = PTHREAD_COND_INITIALIZER,
+};
+
+
+
+/**
+ * add region from commandline spec "[<display>@]<x>,<y>,<w>x<h>:<configfile>"
+ */
+NftResult region_add(const char *spec)
+{
+        if(!spec)
+                NFT_LOG_NULL(NFT_FAILURE);
+
+        if(_c.n >= REGIONS_MAX)
+        {
+                NFT_LOG(L_ERROR, "Too many regions (max. %d)", REGIONS_MAX);
+                return NFT_FAILURE;
+        }
+
+        Region *r = &_c.regions[_c.n];
+        memset(r, 0, sizeof(Region));
+
+        /* region on other display */
+        const char *at = strchr(spec, '@'), *comma = strchr(spec, ',');
+        if(at && comma && at < comma)
+        {
+#ifdef HAVE_X
+                if((size_t) (at - spec) >= sizeof(r->display) || at == spec)
+                {
+                        NFT_LOG(L_ERROR, "Invalid display in region \"%s\"",
+                                spec);
+                        return NFT_FAILURE;
+                }
+                memcpy(r->display, spec, at - spec);
+                r->display[at - spec] = '\0';
+                spec = at + 1;
+#else
+                NFT_LOG(L_ERROR,
+                        "Regions on other displays need X11 support");
+                return NFT_FAILURE;
+#endif /* HAVE_X */
+        }
+
+        int x, y, w, h, n = 0;
+        if(sscanf(spec, "%d,%d,%dx%d:%n", &x, &y, &w, &h, &n) != 4 || !n ||
+           !spec[n])
+        {
+                NFT_LOG(L_ERROR,
+                        "Invalid region \"%s\" (expected [<display>@]<x>,<y>,<w>x<h>:<configfile>)",
+                        spec);
+                return NFT_FAILURE;
+        }
+
+        if(x < 0 || y < 0 || w < 0 || h < 0)
+        {
+                NFT_LOG(L_ERROR, "Invalid region \"%s\"", spec);
+                return NFT_FAILURE;
+        }
+
+        if(strlen(spec + n) >= sizeof(r->prefsfile))
+        {
+                NFT_LOG(L_ERROR, "Filename \"%s\" too long", spec + n);
+                return NFT_FAILURE;
+        }
+
+        r->x = x;
+        r->y = y;
+        r->w = w;
+        r->h = h;
+        strcpy(r->prefsfile, spec + n);
+        _c.n++;
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * amount of additional regions
+ */
+int region_count()
+{
+        return _c.n;
+}
+
+
+/**
+ * load setups of all regions
+ */
+NftResult region_init(LedPrefs * prefs)
+{
+        if(!prefs)
+                NFT_LOG_NULL(NFT_FAILURE);
+
+        int i;
+        for(i = 0; i < _c.n; i++)
+        {
+                Region *r = &_c.regions[i];
+
+                LedPrefsNode *pnode;
+                if(!(pnode = led_prefs_node_from_file(prefs, r->prefsfile)))
+                {
+                        NFT_LOG(L_ERROR, "Failed to open configfile \"%s\"",
+                                r->prefsfile);
+                        return NFT_FAILURE;
+                }
+
+                r->setup = led_prefs_setup_from_node(prefs, pnode);
+                led_prefs_node_free(pnode);
+                if(!r->setup)
+                {
+                        NFT_LOG(L_ERROR, "No valid setup found in \"%s\"",
+                                r->prefsfile);
+                        return NFT_FAILURE;
+                }
+
+                /* region must at least cover the setup */
+                LedFrameCord w, h;
+                if(!led_setup_get_dim(r->setup, &w, &h))
+                        return NFT_FAILURE;
+
+                if(w > r->w)
+                        r->w = w;
+                if(h > r->h)
+                        r->h = h;
+
+                if(!(r->hw = led_setup_get_hardware(r->setup)))
+                        return NFT_FAILURE;
+
+#ifdef HAVE_X
+                /* connect before the capture mechanism talks to X */
+                if(r->display[0] && !(r->x11 = x11_display_open(r->display)))
+                        return NFT_FAILURE;
+#endif /* HAVE_X */
+
+                NFT_LOG(L_INFO, "Region %d: %dx%d at %d/%d of %s (%s)",
+                        i + 1, r->w, r->h, r->x, r->y,
+                        r->display[0] ? r->display : "grab", r->prefsfile);
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * extend rectangle so it covers all regions
+ */
+void region_bounds(LedFrameCord * x, LedFrameCord * y, LedFrameCord * w,
+                   LedFrameCord * h)
+{
+        LedFrameCord x1 = *x + *w, y1 = *y + *h;
+
+        int i;
+        for(i = 0; i < _c.n; i++)
+        {
+                Region *r = &_c.regions[i];
+
+                /* captured on its own */
+                if(r->display[0])
+                        continue;
+
+                if(r->x < *x)
+                        *x = r->x;
+                if(r->y < *y)
+                        *y = r->y;
+                if(r->x + r->w > x1)
+                        x1 = r->x + r->w;
+                if(r->y + r->h > y1)
+                        y1 = r->y + r->h;
+        }
+
+        *w = x1 - *x;
+        *h = y1 - *y;
+}
+
+
+/**
+ * copy rectangle at x/y of src into dst (as large as dst), converting
+ * every row
+ */
+void region_crop(LedFrame * dst, LedFrame * src, LedFrameCord x,
+                 LedFrameCord y, ConvertKernel convert)
+{
+        LedFrameCord w, h, sw, sh;
+        led_frame_get_dim(dst, &w, &h);
+        led_frame_get_dim(src, &sw, &sh);
+
+        size_t sbpp = led_pixel_format_get_bytes_per_pixel
+                (led_frame_get_format(src));
+        size_t dbpp = led_pixel_format_get_bytes_per_pixel
+                (led_frame_get_format(dst));
+
+        const uint8_t *s = (const uint8_t *) led_frame_get_buffer(src) +
+                ((size_t) y * sw + x) * sbpp;
+        uint8_t *d = led_frame_get_buffer(dst);
+
+        LedFrameCord row;
+        for(row = 0; row < h; row++, s += sw * sbpp, d += w * dbpp)
+        {
+                if(convert)
+                        convert_run(convert, d, s, w);
+                else
+                        memcpy(d, s, w * sbpp);
+        }
+}
+
+
+/**
+ * fill chains of region from its frame
+ */
+static NftResult _fill(Region * r, int index)
+{
+        NftResult res = NFT_SUCCESS;
+
+        LedHardware *h;
+        for(h = r->hw; h; h = led_hardware_list_get_next(h))
+        {
+                if(!led_chain_fill_from_frame(led_hardware_get_chain(h),
+                                              r->frame))
+                {
+                        NFT_LOG(L_ERROR, "Error while mapping region %d",
+                                index + 1);
+                        res = NFT_FAILURE;
+                }
+        }
+
+        return res;
+}
+
+
+#ifdef HAVE_X
+
+/**
+ * allocate frame as captured from display of region (if it needs
+ * conversion) & tell which format the region frame gets
+ */
+static NftResult _display_frames(Region * r, const char **format,
+                                 bool *big_endian)
+{
+        const char *captured = x11_display_format(r->x11);
+        bool swapped = x11_display_is_big_endian(r->x11);
+
+        if((r->convert = convert_kernel(captured, swapped, format)))
+        {
+                if(!(r->raw = led_frame_new(r->w, r->h,
+                                            led_pixel_format_from_string
+                                            (captured))))
+                        return NFT_FAILURE;
+                led_frame_set_big_endian(r->raw, swapped);
+                *big_endian = false;
+        }
+        else
+        {
+                *big_endian = swapped;
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * capture, map & send region of other display
+ */
+static NftResult _display_tick(Region * r)
+{
+        int index = r - _c.regions;
+
+        if(!x11_display_capture(r->x11, r->raw ? r->raw : r->frame, r->x,
+                                r->y))
+        {
+                NFT_LOG(L_ERROR, "Capturing region %d from \"%s\" failed",
+                        index + 1, r->display);
+                return NFT_FAILURE;
+        }
+
+        if(r->raw)
+                region_crop(r->frame, r->raw, 0, 0, r->convert);
+
+        if(!_fill(r, index))
+                return NFT_FAILURE;
+
+        return led_hardware_list_send(r->hw);
+}
+
+#endif /* HAVE_X */
+
+
+/**
+ * thread processing a region of another display every tick
+ */
+static void *_thread(void *arg)
+{
+        Region *r = arg;
+        unsigned long generation = 0;
+
+        pthread_mutex_lock(&_c.lock);
+        while(true)
+        {
+                while(!_c.quit && _c.generation == generation)
+                        pthread_cond_wait(&_c.start, &_c.lock);
+
+                if(_c.quit)
+                        break;
+
+                generation = _c.generation;
+                pthread_mutex_unlock(&_c.lock);
+
+#ifdef HAVE_X
+                r->result = _display_tick(r);
+#else
+                (void) r;
+#endif /* HAVE_X */
+
+                pthread_mutex_lock(&_c.lock);
+                if(--_c.pending == 0)
+                        pthread_cond_signal(&_c.done);
+        }
+        pthread_mutex_unlock(&_c.lock);
+
+        return NULL;
+}
+
+
+/**
+ * allocate frames of all regions & map chains from them
+ *
+ * @param format pixel-format of region frames
+ * @param big_endian byte-order of region frames
+ * @param convert conversion from grabbed frame to format
+ */
+NftResult region_map(const char *format, bool big_endian,
+                     ConvertKernel convert)
+{
+        _c.convert = convert;
+
+        int i;
+        for(i = 0; i < _c.n; i++)
+        {
+                Region *r = &_c.regions[i];
+                const char *f = format;
+                bool swapped = big_endian;
+
+#ifdef HAVE_X
+                /* display regions convert from format of their display */
+                if(r->x11 && !_display_frames(r, &f, &swapped))
+                        return NFT_FAILURE;
+#endif /* HAVE_X */
+
+                if(!(r->frame = led_frame_new(r->w, r->h,
+                                              led_pixel_format_from_string
+                                              (f))))
+                        return NFT_FAILURE;
+                led_frame_set_big_endian(r->frame, swapped);
+
+                if(!led_hardware_list_refresh_mapping(r->hw))
+                        return NFT_FAILURE;
+
+                if(!led_chain_map_from_frame(led_hardware_get_chain(r->hw),
+                                             r->frame))
+                        return NFT_FAILURE;
+
+                if(!led_hardware_list_refresh_gain(r->hw))
+                        return NFT_FAILURE;
+
+                led_hardware_print(r->hw, L_VERBOSE);
+
+                if(r->display[0])
+                {
+                        if(pthread_create(&r->thread, NULL, _thread, r) != 0)
+                        {
+                                NFT_LOG_PERROR("pthread_create()");
+                                return NFT_FAILURE;
+                        }
+                        r->running = true;
+                        _c.threads++;
+                }
+        }
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * cut regions out of grabbed frame & fill chains and/or send them
+ *
+ * @param grab grabbed frame covering all regions
+ * @param x screen position of grab
+ * @param y screen position of grab
+ * @param jobs what to do
+ */
+NftResult region_output(LedFrame * grab, LedFrameCord x, LedFrameCord y,
+                        OutputJob jobs)
+{
+        NftResult res = NFT_SUCCESS;
+
+        int i;
+        for(i = 0; i < _c.n; i++)
+        {
+                Region *r = &_c.regions[i];
+
+                /* processed by its own thread */
+                if(r->display[0])
+                        continue;
+
+                if(jobs & OUTPUT_FILL)
+                {
+                        region_crop(r->frame, grab, r->x - x, r->y - y,
+                                    _c.convert);
+
+                        if(!_fill(r, i))
+                                res = NFT_FAILURE;
+                }
+
+                if(jobs & OUTPUT_SEND)
+                        led_hardware_list_send(r->hw);
+        }
+
+        return res;
+}
+
+
+/**
+ * let threads of regions on other displays start processing next frame
+ */
+void region_start()
+{
+        if(!_c.threads)
+                return;
+
+        pthread_mutex_lock(&_c.lock);
+        _c.pending = _c.threads;
+        _c.generation++;
+        pthread_cond_broadcast(&_c.start);
+        pthread_mutex_unlock(&_c.lock);
+}
+
+
+/**
+ * wait until threads of regions on other displays are done
+ */
+NftResult region_wait()
+{
+        pthread_mutex_lock(&_c.lock);
+        while(_c.pending)
+                pthread_cond_wait(&_c.done, &_c.lock);
+        pthread_mutex_unlock(&_c.lock);
+
+        NftResult res = NFT_SUCCESS;
+
+        int i;
+        for(i = 0; i < _c.n; i++)
+        {
+                if(!_c.regions[i].running || _c.regions[i].result)
+                        continue;
+
+                NFT_LOG(L_ERROR, "Region on display \"%s\" failed",
+                        _c.regions[i].display);
+                res = NFT_FAILURE;
+        }
+
+        return res;
+}
+
+
+/**
+ * latch hardware of all regions
+ */
+void region_show()
+{
+        int i;
+        for(i = 0; i < _c.n; i++)
+                led_hardware_list_show(_c.regions[i].hw);
+}
+
+
+/**
+ * free all regions
+ */
+void region_deinit()
+{
+        /* stop threads after their current tick */
+        region_wait();
+        pthread_mutex_lock(&_c.lock);
+        _c.quit = true;
+        pthread_cond_broadcast(&_c.start);
+        pthread_mutex_unlock(&_c.lock);
+
+        int i;
+        for(i = 0; i < _c.n; i++)
+        {
+                Region *r = &_c.regions[i];
+
+                if(r->running)
+                        pthread_join(r->thread, NULL);
+                r->running = false;
+
+#ifdef HAVE_X
+                x11_display_close(r->x11);
+                r->x11 = NULL;
+#endif /* HAVE_X */
+                led_frame_destroy(r->raw);
+                r->raw = NULL;
+                led_frame_destroy(r->frame);
+                r->frame = NULL;
+                led_setup_destroy(r->setup);
+                r->setup = NULL;
+                r->hw = NULL;
+        }
+}
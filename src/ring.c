@@ -0,0 +1,367 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * lock-free single-producer/single-consumer ring of preallocated frames
+ *
+ * Every slot has one atomic word holding its state and the sequence number
+ * of the frame it holds. The producer writes FREE slots, the consumer reads
+ * READY slots. In "latest" mode the consumer always takes the newest READY
+ * frame and the producer may overwrite READY frames that are not the newest
+ * one, so the producer never waits and the consumer never gets a stale
+ * frame. Otherwise frames are consumed in order and none are dropped.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <niftyled.h>
+#include "ring.h"
+
+
+/** states of a slot */
+enum
+{
+        SLOT_FREE = 0,
+        SLOT_WRITING,
+        SLOT_READY,
+        SLOT_READING,
+};
+
+/** helper macros to (de)compose slot words */
+#define SLOT_WORD(seq, state) (((seq) << 2) | (state))
+#define SLOT_STATE(w) ((w) & 3)
+#define SLOT_SEQ(w) ((w) >> 2)
+
+#ifndef MIN
+#define MIN(a,b) (((a) < (b)) ? (a) : (b))
+#endif
+
+/** longest sleep while waiting for a slot (nanoseconds) */
+#define RING_BACKOFF_MAX 1000000
+
+
+/** one slot of the ring */
+typedef struct
+{
+        /** state & sequence (accessed atomically) */
+        uint64_t word;
+        /** preallocated frame */
+        LedFrame *frame;
+} Slot;
+
+
+struct _FrameRing
+{
+        /** slots of this ring */
+        Slot *slots;
+        /** amount of slots */
+        size_t depth;
+        /** "latest frame wins" drop policy */
+        bool latest;
+        /** sequence number of last published frame (producer only) */
+        uint64_t seq;
+        /** sequence number of last read frame (consumer only) */
+        uint64_t read_seq;
+        /** amount of frames overwritten before they were read */
+        unsigned long dropped;
+};
+
+
+
+/**
+ * sleep a little longer each time we are called
+ *
+ * @param n counter, initialize with 0 before first call
+ */
+void ring_backoff(unsigned int *n)
+{
+        long ns = 10000L << MIN(*n, 7);
+        struct timespec ts = {.tv_sec = 0,.tv_nsec =
+                        MIN(ns, RING_BACKOFF_MAX) };
+
+        (*n)++;
+        nanosleep(&ts, NULL);
+}
+
+
+/** check running flag set by another thread */
+static bool _running(const bool * running)
+{
+        return !running || __atomic_load_n(running, __ATOMIC_ACQUIRE);
+}
+
+
+/**
+ * create new ring with depth frames of the same dimensions & format as
+ * prototype
+ */
+FrameRing *ring_new(LedFrame * prototype, size_t depth, bool latest)
+{
+        if(!prototype)
+                NFT_LOG_NULL(NULL);
+
+        /* the consumer holds one, the producer writes one and one is needed
+           to have a frame ready */
+        if(depth < (latest ? 3 : 2))
+        {
+                NFT_LOG(L_ERROR, "Ring depth %zu is too small (min: %d)",
+                        depth, latest ? 3 : 2);
+                return NULL;
+        }
+
+        LedFrameCord w, h;
+        if(!led_frame_get_dim(prototype, &w, &h))
+                return NULL;
+
+        FrameRing *r;
+        if(!(r = calloc(1, sizeof(FrameRing))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+
+        if(!(r->slots = calloc(depth, sizeof(Slot))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                free(r);
+                return NULL;
+        }
+
+        r->depth = depth;
+        r->latest = latest;
+
+        size_t i;
+        for(i = 0; i < depth; i++)
+        {
+                if(!(r->slots[i].frame =
+                     led_frame_new(w, h, led_frame_get_format(prototype))))
+                {
+                        ring_destroy(r);
+                        return NULL;
+                }
+                led_frame_set_big_endian(r->slots[i].frame,
+                                         led_frame_get_big_endian
+                                         (prototype));
+        }
+
+        return r;
+}
+
+
+/**
+ * free ring and all of its frames
+ */
+void ring_destroy(FrameRing * r)
+{
+        if(!r)
+                return;
+
+        size_t i;
+        for(i = 0; i < r->depth; i++)
+        {
+                if(r->slots[i].frame)
+                        led_frame_destroy(r->slots[i].frame);
+        }
+
+        free(r->slots);
+        free(r);
+}
+
+
+/**
+ * get frame of slot
+ */
+LedFrame *ring_frame(FrameRing * r, int slot)
+{
+        return r->slots[slot].frame;
+}
+
+
+/**
+ * get slot to write next frame to (producer only). Waits until a slot is
+ * available or *running becomes false.
+ *
+ * @result slot or -1 if we stopped running
+ */
+int ring_write_acquire(FrameRing * r, const bool * running)
+{
+        unsigned int n = 0;
+
+        while(_running(running))
+        {
+                int slot = -1;
+                uint64_t oldest = 0, word = 0;
+
+                /* find free slot or oldest stale frame */
+                size_t i;
+                for(i = 0; i < r->depth; i++)
+                {
+                        uint64_t w = __atomic_load_n(&r->slots[i].word,
+                                                     __ATOMIC_ACQUIRE);
+
+                        if(SLOT_STATE(w) == SLOT_FREE)
+                        {
+                                slot = i;
+                                word = w;
+                                break;
+                        }
+
+                        /* never overwrite newest frame */
+                        if(r->latest && SLOT_STATE(w) == SLOT_READY &&
+                           SLOT_SEQ(w) != r->seq &&
+                           (slot < 0 || SLOT_SEQ(w) < oldest))
+                        {
+                                slot = i;
+                                word = w;
+                                oldest = SLOT_SEQ(w);
+                        }
+                }
+
+                /* consumer might have grabbed slot in the meantime */
+                if(slot >= 0 &&
+                   __atomic_compare_exchange_n(&r->slots[slot].word, &word,
+                                               SLOT_WORD(SLOT_SEQ(word),
+                                                         SLOT_WRITING), false,
+                                               __ATOMIC_ACQUIRE,
+                                               __ATOMIC_RELAXED))
+                {
+                        if(SLOT_STATE(word) == SLOT_READY)
+                                __atomic_add_fetch(&r->dropped, 1,
+                                                   __ATOMIC_RELAXED);
+
+                        return slot;
+                }
+
+                if(slot < 0)
+                        ring_backoff(&n);
+        }
+
+        return -1;
+}
+
+
+/**
+ * make written frame available to consumer (producer only)
+ */
+void ring_write_publish(FrameRing * r, int slot)
+{
+        r->seq++;
+        __atomic_store_n(&r->slots[slot].word,
+                         SLOT_WORD(r->seq, SLOT_READY), __ATOMIC_RELEASE);
+}
+
+
+/**
+ * get slot holding next frame to read (consumer only). Waits until a frame
+ * is available or *running becomes false.
+ *
+ * @result slot or -1 if we stopped running
+ */
+int ring_read_acquire(FrameRing * r, const bool * running)
+{
+        unsigned int n = 0;
+
+        while(_running(running))
+        {
+                int slot = -1;
+                uint64_t best = 0, word = 0;
+
+                /* find newest (or oldest) ready frame */
+                size_t i;
+                for(i = 0; i < r->depth; i++)
+                {
+                        uint64_t w = __atomic_load_n(&r->slots[i].word,
+                                                     __ATOMIC_ACQUIRE);
+
+                        /* older frames may still be ready in latest mode */
+                        if(SLOT_STATE(w) != SLOT_READY ||
+                           SLOT_SEQ(w) <= r->read_seq)
+                                continue;
+
+                        if(slot < 0 ||
+                           (r->latest ? SLOT_SEQ(w) > best :
+                            SLOT_SEQ(w) < best))
+                        {
+                                slot = i;
+                                word = w;
+                                best = SLOT_SEQ(w);
+                        }
+                }
+
+                /* producer might have reclaimed slot in the meantime */
+                if(slot >= 0 &&
+                   __atomic_compare_exchange_n(&r->slots[slot].word, &word,
+                                               SLOT_WORD(best, SLOT_READING),
+                                               false, __ATOMIC_ACQUIRE,
+                                               __ATOMIC_RELAXED))
+                {
+                        r->read_seq = best;
+                        return slot;
+                }
+
+                if(slot < 0)
+                        ring_backoff(&n);
+        }
+
+        return -1;
+}
+
+
+/**
+ * give frame back to producer (consumer only)
+ */
+void ring_read_release(FrameRing * r, int slot)
+{
+        __atomic_store_n(&r->slots[slot].word, SLOT_WORD(0, SLOT_FREE),
+                         __ATOMIC_RELEASE);
+}
+
+
+/**
+ * amount of frames that were overwritten before the consumer read them
+ */
+unsigned long ring_dropped(FrameRing * r)
+{
+        return __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,340 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * area-averaging downscale of captured frames
+ *
+ * Every destination pixel is the average of the source area it covers,
+ * source pixels on the border of that area are weighted by how much of
+ * them is covered. Works on any format with 8 bits per component (all
+ * components are averaged the same way).
+ *
+ * The source is processed row by row: each row is reduced horizontally,
+ * then added to the (at most two) destination rows it overlaps. A
+ * destination row is written as soon as it's complete, so the source is
+ * read exactly once and only two rows of accumulators are kept.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <niftyled.h>
+#include "scale.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCALE_SSE2
+#include <emmintrin.h>
+#endif
+
+
+/** source pixels a destination pixel is made of */
+typedef struct
+{
+        /** first source pixel */
+        LedFrameCord first;
+        /** weight of first source pixel */
+        uint32_t first_weight;
+        /** pixels after first with full weight */
+        LedFrameCord run;
+        /** weight of pixel after run (0 = none) */
+        uint32_t last_weight;
+} Taps;
+
+
+/** private structure to hold info accros function-calls */
+static struct
+{
+        /** source dimensions */
+        LedFrameCord sw, sh;
+        /** destination dimensions */
+        LedFrameCord dw, dh;
+        /** bytes per pixel */
+        size_t bpp;
+        /** horizontal taps of every destination pixel */
+        Taps *taps;
+        /** horizontally reduced source row (dw * bpp) */
+        uint32_t *row;
+        /** accumulators of current & next destination row */
+        uint32_t *acc[2];
+        /** destination frame */
+        uint8_t *dst;
+} _c;
+
+
+
+/** sum of run of n pixels, per component */
+static void _sum(const uint8_t * s, LedFrameCord n, uint32_t * sum)
+{
+        size_t c;
+        for(c = 0; c < _c.bpp; c++)
+                sum[c] = 0;
+
+        LedFrameCord x = 0;
+
+#ifdef SCALE_SSE2
+        /* 4 pixels of 4 bytes at once, every 16 bit lane gets 2 bytes
+           per iteration so fold into 32 bit every 128 iterations */
+        if(_c.bpp == 4)
+        {
+                __m128i zero = _mm_setzero_si128();
+                __m128i total = zero;
+                while(x + 4 <= n)
+                {
+                        __m128i acc = zero;
+                        int i;
+                        for(i = 0; i < 128 && x + 4 <= n; i++, x += 4)
+                        {
+                                __m128i v = _mm_loadu_si128((const __m128i *)
+                                                            (s + x * 4));
+                                acc = _mm_add_epi16(acc,
+                                                    _mm_unpacklo_epi8(v,
+                                                                      zero));
+                                acc = _mm_add_epi16(acc,
+                                                    _mm_unpackhi_epi8(v,
+                                                                      zero));
+                        }
+
+                        /* fold both pixels of 16 bit lanes into 32 bit */
+                        total = _mm_add_epi32(total,
+                                              _mm_unpacklo_epi16(acc, zero));
+                        total = _mm_add_epi32(total,
+                                              _mm_unpackhi_epi16(acc, zero));
+                }
+
+                uint32_t t[4];
+                _mm_storeu_si128((__m128i *) t, total);
+                for(c = 0; c < 4; c++)
+                        sum[c] = t[c];
+        }
+#endif /* SCALE_SSE2 */
+
+        for(; x < n; x++)
+        {
+                for(c = 0; c < _c.bpp; c++)
+                        sum[c] += s[x * _c.bpp + c];
+        }
+}
+
+
+/** reduce one source row to dw pixels (weighted sums, total weight sw) */
+static void _reduce(const uint8_t * s)
+{
+        LedFrameCord i;
+        for(i = 0; i < _c.dw; i++)
+        {
+                Taps *t = &_c.taps[i];
+                uint32_t *r = &_c.row[i * _c.bpp];
+                const uint8_t *p = s + t->first * _c.bpp;
+                uint32_t run[_c.bpp];
+                size_t c;
+
+                _sum(p + _c.bpp, t->run, run);
+
+                for(c = 0; c < _c.bpp; c++)
+                        r[c] = t->first_weight * p[c] + _c.dw * run[c];
+
+                if(t->last_weight)
+                {
+                        p += (t->run + 1) * _c.bpp;
+                        for(c = 0; c < _c.bpp; c++)
+                                r[c] += t->last_weight * p[c];
+                }
+
+                /* normalize to 0-255 so vertical sums can't overflow */
+                for(c = 0; c < _c.bpp; c++)
+                        r[c] = (r[c] + _c.sw / 2) / _c.sw;
+        }
+}
+
+
+/** add reduced row to accumulator with weight */
+static void _accumulate(uint32_t * acc, uint32_t weight)
+{
+        size_t i, n = _c.dw * _c.bpp;
+        for(i = 0; i < n; i++)
+                acc[i] += weight * _c.row[i];
+}
+
+
+/** write finished destination row & clear its accumulator */
+static void _emit(LedFrameCord j, uint32_t * acc)
+{
+        size_t i, n = _c.dw * _c.bpp;
+        uint8_t *d = _c.dst + j * n;
+        for(i = 0; i < n; i++)
+        {
+                d[i] = (acc[i] + _c.sh / 2) / _c.sh;
+                acc[i] = 0;
+        }
+}
+
+
+/**
+ * prepare downscaling
+ *
+ * @param sw width of source
+ * @param sh height of source
+ * @param dw width of destination (<= sw)
+ * @param dh height of destination (<= sh)
+ * @param bpp bytes per pixel (1 byte per component)
+ */
+NftResult scale_init(LedFrameCord sw, LedFrameCord sh, LedFrameCord dw,
+                     LedFrameCord dh, size_t bpp)
+{
+        if(dw <= 0 || dh <= 0 || dw > sw || dh > sh)
+        {
+                NFT_LOG(L_ERROR, "Can't downscale %dx%d to %dx%d", sw, sh,
+                        dw, dh);
+                return NFT_FAILURE;
+        }
+
+        _c.sw = sw;
+        _c.sh = sh;
+        _c.dw = dw;
+        _c.dh = dh;
+        _c.bpp = bpp;
+
+        if(!(_c.taps = calloc(dw, sizeof(Taps))) ||
+           !(_c.row = calloc(dw * bpp, sizeof(uint32_t))) ||
+           !(_c.acc[0] = calloc(dw * bpp, sizeof(uint32_t))) ||
+           !(_c.acc[1] = calloc(dw * bpp, sizeof(uint32_t))) ||
+           !(_c.dst = malloc(dw * dh * bpp)))
+        {
+                NFT_LOG_PERROR("calloc()");
+                scale_deinit();
+                return NFT_FAILURE;
+        }
+
+        /* destination pixel i covers [i*sw, (i+1)*sw), source pixel x
+           covers [x*dw, (x+1)*dw) */
+        LedFrameCord i;
+        for(i = 0; i < dw; i++)
+        {
+                Taps *t = &_c.taps[i];
+                long long start = (long long) i * sw, end = start + sw;
+
+                t->first = start / dw;
+                long long first_end = (long long) (t->first + 1) * dw;
+                t->first_weight = (first_end < end ? first_end : end) - start;
+
+                long long last = (end - 1) / dw;
+                t->run = 0;
+                t->last_weight = 0;
+                if(last > t->first)
+                {
+                        t->last_weight = end - last * dw;
+                        t->run = last - t->first - 1;
+
+                        /* last pixel fully covered, make it part of run */
+                        if(t->last_weight == (uint32_t) dw)
+                        {
+                                t->run++;
+                                t->last_weight = 0;
+                        }
+                }
+        }
+
+        NFT_LOG(L_VERBOSE, "Downscaling %dx%d to %dx%d", sw, sh, dw, dh);
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * free resources of downscaling
+ */
+void scale_deinit()
+{
+        free(_c.taps);
+        _c.taps = NULL;
+        free(_c.row);
+        _c.row = NULL;
+        free(_c.acc[0]);
+        _c.acc[0] = NULL;
+        free(_c.acc[1]);
+        _c.acc[1] = NULL;
+        free(_c.dst);
+        _c.dst = NULL;
+}
+
+
+/**
+ * downscale frame
+ *
+ * @param src sw * sh pixels
+ * @param stride bytes from one source row to the next
+ * @result dw * dh pixels (valid until next call)
+ */
+const uint8_t *scale_run(const uint8_t * src, size_t stride)
+{
+        /* destination row j covers [j*sh, (j+1)*sh), source row y covers
+           [y*dh, (y+1)*dh) */
+        LedFrameCord y, j = 0;
+        for(y = 0; y < _c.sh; y++)
+        {
+                _reduce(src + y * stride);
+
+                long long start = (long long) y * _c.dh;
+                long long end = start + _c.dh;
+                long long boundary = (long long) (j + 1) * _c.sh;
+
+                if(end <= boundary)
+                {
+                        _accumulate(_c.acc[j & 1], _c.dh);
+                }
+                else
+                {
+                        /* row is split between destination rows j & j+1 */
+                        _accumulate(_c.acc[j & 1], boundary - start);
+                        _accumulate(_c.acc[(j + 1) & 1], end - boundary);
+                }
+
+                if(end >= boundary)
+                {
+                        _emit(j, _c.acc[j & 1]);
+                        j++;
+                }
+        }
+
+        return _c.dst;
+}
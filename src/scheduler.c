@@ -0,0 +1,288 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * frame scheduler: wait for the point in time a frame should be shown.
+ *
+ * Besides the relative delay of niftyled, frames can be shown at absolute
+ * deadlines on CLOCK_MONOTONIC so variance in capture & send time doesn't
+ * add up. Jitter (time between deadline and wakeup) is recorded for the last
+ * SCHEDULER_SAMPLES frames.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include <niftyled.h>
+#include "scheduler.h"
+
+
+/** amount of jitter samples kept for statistics */
+#define SCHEDULER_SAMPLES 1024
+
+/** nanoseconds per second */
+#define NSEC 1000000000LL
+
+
+/** private structure to hold info accros function-calls */
+static struct
+{
+        /** pacing policy */
+        SchedulePolicy policy;
+        /** requested framerate */
+        int fps;
+        /** nanoseconds per frame */
+        long long period;
+        /** next deadline (nanoseconds on CLOCK_MONOTONIC) */
+        long long deadline;
+        /** time of scheduler_init() */
+        long long start;
+        /** amount of frames shown */
+        unsigned long frames;
+        /** amount of deadlines that were skipped */
+        unsigned long skipped;
+        /** amount of deadlines that were missed */
+        unsigned long overruns;
+        /** time the last frame was shown */
+        long long shown;
+        /** smoothed time between shown frames (nanoseconds) */
+        long long interval;
+        /** jitter of the last frames (nanoseconds) */
+        long long jitter[SCHEDULER_SAMPLES];
+        /** amount of valid jitter samples */
+        size_t samples;
+} _c;
+
+
+
+/** current time on CLOCK_MONOTONIC in nanoseconds */
+static long long _now()
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * NSEC + ts.tv_nsec;
+}
+
+
+/** compare two jitter samples */
+static int _cmp(const void *a, const void *b)
+{
+        long long la = *(const long long *) a, lb = *(const long long *) b;
+        return (la > lb) - (la < lb);
+}
+
+
+/**
+ * parse policy name
+ *
+ * @result policy or -1 if name is invalid
+ */
+SchedulePolicy scheduler_policy_from_string(const char *name)
+{
+        if(strcmp(name, "relative") == 0)
+                return SCHEDULE_RELATIVE;
+        if(strcmp(name, "skip") == 0)
+                return SCHEDULE_SKIP;
+        if(strcmp(name, "catchup") == 0)
+                return SCHEDULE_CATCHUP;
+
+        return -1;
+}
+
+
+/**
+ * start scheduling frames
+ */
+NftResult scheduler_init(int fps, SchedulePolicy policy)
+{
+        if(fps <= 0)
+        {
+                NFT_LOG(L_ERROR, "Invalid framerate: %d", fps);
+                return NFT_FAILURE;
+        }
+
+        _c.policy = policy;
+        _c.fps = fps;
+        _c.period = NSEC / fps;
+        _c.start = _now();
+        _c.deadline = _c.start + _c.period;
+        _c.frames = 0;
+        _c.skipped = 0;
+        _c.overruns = 0;
+        _c.shown = 0;
+        _c.interval = 0;
+        _c.samples = 0;
+
+        /* initially sample time for frametiming */
+        if(policy == SCHEDULE_RELATIVE)
+                return led_fps_sample();
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * sleep until next frame should be shown
+ */
+NftResult scheduler_wait()
+{
+        if(_c.policy == SCHEDULE_RELATIVE)
+                return led_fps_delay(_c.fps);
+
+        long long now = _now();
+
+        /* deadline missed? */
+        if(now > _c.deadline)
+        {
+                _c.overruns++;
+
+                /* wait for next deadline that's still in the future
+                   (otherwise show now & keep schedule to catch up) */
+                if(_c.policy == SCHEDULE_SKIP)
+                {
+                        long long missed = (now - _c.deadline) / _c.period + 1;
+                        _c.deadline += missed * _c.period;
+                        _c.skipped += missed;
+                }
+        }
+
+        /* sleep until deadline */
+        struct timespec ts = {.tv_sec = _c.deadline / NSEC,
+                .tv_nsec = _c.deadline % NSEC
+        };
+        int err;
+        while((err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts,
+                                     NULL)) == EINTR);
+        if(err)
+        {
+                errno = err;
+                NFT_LOG_PERROR("clock_nanosleep()");
+                return NFT_FAILURE;
+        }
+
+        /* record jitter */
+        _c.jitter[_c.frames % SCHEDULER_SAMPLES] = _now() - _c.deadline;
+        if(_c.samples < SCHEDULER_SAMPLES)
+                _c.samples++;
+
+        _c.deadline += _c.period;
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * call after frame was shown
+ */
+NftResult scheduler_shown()
+{
+        _c.frames++;
+
+        /* smooth interval between frames over the last few frames */
+        long long now = _now();
+        if(_c.shown)
+                _c.interval += (now - _c.shown - _c.interval) / 8;
+        _c.shown = now;
+
+        /* save time when frame is displayed */
+        if(_c.policy == SCHEDULE_RELATIVE)
+                return led_fps_sample();
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * framerate achieved during the last frames
+ */
+double scheduler_fps()
+{
+        return _c.interval > 0 ? (double) NSEC / _c.interval : 0.0;
+}
+
+
+/**
+ * amount of deadlines that were missed
+ */
+unsigned long scheduler_overruns()
+{
+        return _c.overruns;
+}
+
+
+/**
+ * amount of deadlines that were skipped
+ */
+unsigned long scheduler_skipped()
+{
+        return _c.skipped;
+}
+
+
+/**
+ * print achieved framerate & jitter
+ */
+void scheduler_report(NftLoglevel level)
+{
+        long long elapsed = _now() - _c.start;
+
+        NFT_LOG(level, "%lu frames in %.2f s (%.2f fps, requested: %d)",
+                _c.frames, (double) elapsed / NSEC,
+                elapsed > 0 ? (double) _c.frames * NSEC / elapsed : 0.0,
+                _c.fps);
+
+        if(_c.policy == SCHEDULE_RELATIVE || _c.samples == 0)
+                return;
+
+        /* calculate percentiles of recorded jitter */
+        long long sorted[SCHEDULER_SAMPLES];
+        memcpy(sorted, _c.jitter, _c.samples * sizeof(long long));
+        qsort(sorted, _c.samples, sizeof(long long), _cmp);
+
+        NFT_LOG(level,
+                "Jitter over last %zu frames: p50 %.3f ms, p99 %.3f ms, max %.3f ms "
+                "(%lu overruns, %lu frames skipped)", _c.samples,
+                sorted[_c.samples / 2] / 1e6,
+                sorted[(_c.samples * 99) / 100] / 1e6,
+                sorted[_c.samples - 1] / 1e6, _c.overruns, _c.skipped);
+}
@@ -0,0 +1,446 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * shared-memory frame ring (see shmring.h for the protocol)
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <niftyled.h>
+#include "shmring.h"
+
+
+/** how often a reader retries when the producer overwrote its slot */
+#define SHMRING_RETRIES 8
+
+/** round up to SHMRING_ALIGN */
+#define SHMRING_ALIGNED(n) (((n) + SHMRING_ALIGN - 1) & ~((uint64_t) SHMRING_ALIGN - 1))
+
+
+struct _ShmRing
+{
+        /** name of shared-memory object */
+        char name[256];
+        /** mapping of whole object */
+        uint8_t *map;
+        /** size of mapping */
+        size_t size;
+        /** true if we created the ring (and are the producer) */
+        bool owner;
+        /** number of last published frame (producer only) */
+        uint64_t seq;
+        /** copy of header as validated when the ring was mapped. The
+            producer may rewrite the mapped one, only "magic" & "latest"
+            are read from there */
+        ShmRingHeader hdr;
+};
+
+
+
+/** header in shared memory */
+static ShmRingHeader *_mapped(ShmRing * r)
+{
+        return (ShmRingHeader *) r->map;
+}
+
+
+/** pointer to slot header */
+static ShmRingSlot *_slot(ShmRing * r, uint64_t n)
+{
+        return (ShmRingSlot *) (r->map + r->hdr.header_size +
+                                (n % r->hdr.slots) * r->hdr.slot_size);
+}
+
+
+/** pointer to pixels of slot */
+static uint8_t *_pixels(ShmRingSlot * s)
+{
+        return (uint8_t *) s + SHMRING_ALIGN;
+}
+
+
+/**
+ * create ring & become its producer. An existing object of the same name
+ * is replaced.
+ *
+ * @param name name of shared-memory object (e.g. "/ledcap")
+ * @param w width of frames
+ * @param h height of frames
+ * @param format niftyled pixel-format of frames
+ * @param bpp bytes per pixel
+ * @param big_endian byte-order of frames
+ * @param slots amount of slots (at least 3 recommended)
+ * @result ring or NULL
+ */
+ShmRing *shmring_create(const char *name, LedFrameCord w, LedFrameCord h,
+                        const char *format, size_t bpp, bool big_endian,
+                        size_t slots)
+{
+        if(!name || !format)
+                NFT_LOG_NULL(NULL);
+
+        if(strlen(format) >= sizeof(((ShmRingHeader *) 0)->format))
+        {
+                NFT_LOG(L_ERROR, "Format \"%s\" too long", format);
+                return NULL;
+        }
+
+        ShmRing *r;
+        if(!(r = calloc(1, sizeof(ShmRing))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+        strncpy(r->name, name, sizeof(r->name) - 1);
+
+        uint64_t header_size = SHMRING_ALIGNED(sizeof(ShmRingHeader));
+        uint64_t slot_size = SHMRING_ALIGNED(SHMRING_ALIGN +
+                                             (uint64_t) w * h * bpp);
+        r->size = header_size + slots * slot_size;
+
+        /* readers of a previous ring keep their mapping */
+        shm_unlink(name);
+
+        int fd;
+        if((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644)) < 0)
+        {
+                NFT_LOG(L_ERROR, "Failed to create shared-memory \"%s\"",
+                        name);
+                NFT_LOG_PERROR("shm_open()");
+                goto _sc_error;
+        }
+        r->owner = true;
+
+        if(ftruncate(fd, r->size) < 0)
+        {
+                NFT_LOG_PERROR("ftruncate()");
+                close(fd);
+                goto _sc_error;
+        }
+
+        r->map = mmap(NULL, r->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+                      0);
+        close(fd);
+        if(r->map == MAP_FAILED)
+        {
+                r->map = NULL;
+                NFT_LOG_PERROR("mmap()");
+                goto _sc_error;
+        }
+
+        /* new object is zeroed, so latest & all slot sequences are 0 */
+        ShmRingHeader *hdr = (ShmRingHeader *) r->map;
+        hdr->version = SHMRING_VERSION;
+        hdr->width = w;
+        hdr->height = h;
+        hdr->bpp = bpp;
+        hdr->big_endian = big_endian;
+        strcpy(hdr->format, format);
+        hdr->slots = slots;
+        hdr->header_size = header_size;
+        hdr->slot_size = slot_size;
+        r->hdr = *hdr;
+        __atomic_store_n(&hdr->magic, SHMRING_MAGIC, __ATOMIC_RELEASE);
+
+        NFT_LOG(L_INFO, "Publishing %dx%d frames (%s) to \"%s\"", w, h,
+                format, name);
+
+        return r;
+
+_sc_error:
+        shmring_close(r);
+        return NULL;
+}
+
+
+/**
+ * publish frame. Never waits for readers
+ *
+ * @param r ring created with shmring_create()
+ * @param src width * height pixels
+ */
+void shmring_publish(ShmRing * r, const uint8_t * src)
+{
+        ShmRingHeader *hdr = &r->hdr;
+        uint64_t n = ++r->seq;
+        ShmRingSlot *slot = _slot(r, n);
+
+        /* mark slot as being written before touching pixels */
+        __atomic_store_n(&slot->seq, 2 * n - 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+
+        memcpy(_pixels(slot), src,
+               (size_t) hdr->width * hdr->height * hdr->bpp);
+
+        __atomic_store_n(&slot->seq, 2 * n, __ATOMIC_RELEASE);
+        __atomic_store_n(&_mapped(r)->latest, n, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * map existing ring (read-only)
+ *
+ * @param name name of shared-memory object (e.g. "/ledcap")
+ * @result ring or NULL
+ */
+ShmRing *shmring_open(const char *name)
+{
+        if(!name)
+                NFT_LOG_NULL(NULL);
+
+        ShmRing *r;
+        if(!(r = calloc(1, sizeof(ShmRing))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NULL;
+        }
+        strncpy(r->name, name, sizeof(r->name) - 1);
+
+        int fd;
+        if((fd = shm_open(name, O_RDONLY, 0)) < 0)
+        {
+                NFT_LOG(L_ERROR, "Failed to open shared-memory \"%s\"", name);
+                NFT_LOG_PERROR("shm_open()");
+                goto _so_error;
+        }
+
+        struct stat st;
+        if(fstat(fd, &st) < 0)
+        {
+                NFT_LOG_PERROR("fstat()");
+                close(fd);
+                goto _so_error;
+        }
+
+        if((size_t) st.st_size < sizeof(ShmRingHeader))
+        {
+                NFT_LOG(L_ERROR, "Shared-memory \"%s\" too small", name);
+                close(fd);
+                goto _so_error;
+        }
+
+        r->size = st.st_size;
+        r->map = mmap(NULL, r->size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if(r->map == MAP_FAILED)
+        {
+                r->map = NULL;
+                NFT_LOG_PERROR("mmap()");
+                goto _so_error;
+        }
+
+        /* validate our own copy, the producer can't change it later */
+        if(__atomic_load_n(&_mapped(r)->magic, __ATOMIC_ACQUIRE) !=
+           SHMRING_MAGIC)
+        {
+                NFT_LOG(L_ERROR, "\"%s\" is no frame ring (or no producer)",
+                        name);
+                goto _so_error;
+        }
+
+        memcpy(&r->hdr, r->map, sizeof(ShmRingHeader));
+        ShmRingHeader *h = &r->hdr;
+        if(h->version != SHMRING_VERSION)
+        {
+                NFT_LOG(L_ERROR, "Unsupported frame ring version %u",
+                        h->version);
+                goto _so_error;
+        }
+
+        /* pixels must fit into slots, slots into the mapping */
+        if(!h->slots || !h->width || !h->height ||
+           h->format[sizeof(h->format) - 1] != '\0' ||
+           h->header_size < sizeof(ShmRingHeader) ||
+           h->header_size > r->size ||
+           h->slot_size < SHMRING_ALIGN ||
+           (h->slot_size - SHMRING_ALIGN) / h->width / h->height < h->bpp ||
+           h->slot_size > (r->size - h->header_size) / h->slots)
+        {
+                NFT_LOG(L_ERROR, "Frame ring \"%s\" has an invalid header",
+                        name);
+                goto _so_error;
+        }
+
+        /* frames are allocated from format, lines are copied with bpp */
+        LedPixelFormat *f;
+        if(!(f = led_pixel_format_from_string(h->format)) ||
+           led_pixel_format_get_bytes_per_pixel(f) != h->bpp)
+        {
+                NFT_LOG(L_ERROR,
+                        "Frame ring \"%s\": %u bytes per pixel don't match format \"%s\"",
+                        name, h->bpp, h->format);
+                goto _so_error;
+        }
+
+        NFT_LOG(L_VERBOSE, "Frame ring \"%s\": %ux%u %s, %u slots", name,
+                h->width, h->height, h->format, h->slots);
+
+        return r;
+
+_so_error:
+        shmring_close(r);
+        return NULL;
+}
+
+
+/**
+ * unmap ring (producer: tell readers we're gone & remove ring)
+ */
+void shmring_close(ShmRing * r)
+{
+        if(!r)
+                return;
+
+        if(r->map)
+        {
+                if(r->owner)
+                        __atomic_store_n(&_mapped(r)->magic, 0,
+                                         __ATOMIC_RELEASE);
+                munmap(r->map, r->size);
+        }
+
+        if(r->owner)
+                shm_unlink(r->name);
+
+        free(r);
+}
+
+
+/**
+ * get header of ring as validated when it was mapped ("latest" isn't
+ * updated)
+ */
+const ShmRingHeader *shmring_header(ShmRing * r)
+{
+        return &r->hdr;
+}
+
+
+/**
+ * check if the producer of ring is still alive
+ */
+bool shmring_alive(ShmRing * r)
+{
+        return __atomic_load_n(&_mapped(r)->magic,
+                               __ATOMIC_ACQUIRE) == SHMRING_MAGIC;
+}
+
+
+/**
+ * copy rectangle of newest frame
+ *
+ * @param r ring
+ * @param dst w * h pixels (undefined contents upon failure)
+ * @param x x-offset of rectangle
+ * @param y y-offset of rectangle
+ * @param w width of rectangle
+ * @param h height of rectangle
+ * @param seq space for number of copied frame (0 if none was published)
+ */
+NftResult shmring_read(ShmRing * r, uint8_t * dst, LedFrameCord x,
+                       LedFrameCord y, LedFrameCord w, LedFrameCord h,
+                       uint64_t * seq)
+{
+        const ShmRingHeader *hdr = &r->hdr;
+
+        if(x < 0 || y < 0 || (uint32_t) (x + w) > hdr->width ||
+           (uint32_t) (y + h) > hdr->height)
+        {
+                NFT_LOG(L_ERROR,
+                        "Capture rectangle %dx%d at %d/%d exceeds ring (%ux%u)",
+                        w, h, x, y, hdr->width, hdr->height);
+                return NFT_FAILURE;
+        }
+
+        size_t stride = (size_t) hdr->width * hdr->bpp;
+        size_t line = (size_t) w * hdr->bpp;
+
+        int retry;
+        for(retry = 0; retry < SHMRING_RETRIES; retry++)
+        {
+                uint64_t n = __atomic_load_n(&_mapped(r)->latest,
+                                             __ATOMIC_ACQUIRE);
+                if(n == 0)
+                {
+                        *seq = 0;
+                        return NFT_SUCCESS;
+                }
+
+                ShmRingSlot *slot = _slot(r, n);
+                uint64_t s = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+                if(s != 2 * n)
+                        continue;
+
+                uint8_t *src = _pixels(slot) + y * stride + x * hdr->bpp;
+                if(line == stride)
+                {
+                        memcpy(dst, src, h * line);
+                }
+                else
+                {
+                        LedFrameCord i;
+                        for(i = 0; i < h; i++)
+                                memcpy(dst + i * line, src + i * stride,
+                                       line);
+                }
+
+                /* was slot overwritten while we copied? */
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+                if(__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != s)
+                        continue;
+
+                *seq = n;
+                return NFT_SUCCESS;
+        }
+
+        NFT_LOG(L_WARNING, "Producer of \"%s\" overwrites frames too fast",
+                r->name);
+        return NFT_FAILURE;
+}
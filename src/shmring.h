@@ -0,0 +1,152 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * shared-memory frame ring
+ *
+ * Lets other processes hand frames to ledcap (and ledcap hand captured
+ * frames to others) without going through X. The ring is a POSIX
+ * shared-memory object (shm_open()) laid out like this:
+ *
+ *   ShmRingHeader                 (header_size bytes)
+ *   slot 0: ShmRingSlot + pixels  (slot_size bytes)
+ *   slot 1: ShmRingSlot + pixels
+ *   ...
+ *
+ * All integers are in host byte-order, all offsets/sizes are multiples of
+ * SHMRING_ALIGN. Pixels of a slot are width * height pixels of "format"
+ * (a niftyled pixel-format like "RGB u8"), lines are width * bpp bytes.
+ *
+ * Producer protocol (exactly one producer per ring):
+ *   1. create the object, size it with ftruncate() & fill in the header
+ *      with "latest" = 0 and every slot's "seq" = 0. Write "magic" last.
+ *   2. for frame number n = 1, 2, 3...:
+ *        slot = n % slots
+ *        store slot.seq = 2n - 1   (odd: being written)
+ *        release fence             (pixels must not pass the odd seq)
+ *        write pixels of slot
+ *        store slot.seq = 2n       (even: complete, release order)
+ *        store header.latest = n   (release order)
+ *   3. on exit, store "magic" = 0 before unlinking the object so readers
+ *      notice the producer went away.
+ *
+ * shmring_create() & shmring_publish() implement the producer side.
+ *
+ * Consumers never write to the ring. To read the newest frame:
+ *        n = header.latest         (acquire order, 0: nothing published)
+ *        slot = n % slots
+ *        s = slot.seq              (acquire order)
+ *        retry if s != 2n          (producer already reuses the slot)
+ *        copy pixels
+ *        retry if slot.seq != s    (acquire order, slot was overwritten)
+ * With 3 or more slots a retry only happens if the consumer is more than
+ * one frame period slower than the producer.
+ */
+
+#ifndef _SHMRING_H
+#define _SHMRING_H
+
+#include <stdint.h>
+
+
+/** identifies a ledcap frame ring ("LEDR") */
+#define SHMRING_MAGIC 0x4c454452
+/** version of ring layout */
+#define SHMRING_VERSION 1
+/** alignment of header & slots */
+#define SHMRING_ALIGN 64
+
+
+/** header at the start of the shared-memory object */
+typedef struct
+{
+        /** SHMRING_MAGIC while the producer is alive, 0 otherwise */
+        uint32_t                        magic;
+        /** SHMRING_VERSION */
+        uint32_t                        version;
+        /** width of frames in pixels */
+        uint32_t                        width;
+        /** height of frames in pixels */
+        uint32_t                        height;
+        /** bytes per pixel */
+        uint32_t                        bpp;
+        /** 1 if pixels are big-endian */
+        uint32_t                        big_endian;
+        /** niftyled pixel-format of frames (0-terminated) */
+        char                            format[32];
+        /** amount of slots */
+        uint32_t                        slots;
+        /** unused, 0 */
+        uint32_t                        reserved;
+        /** offset of first slot */
+        uint64_t                        header_size;
+        /** distance between slots */
+        uint64_t                        slot_size;
+        /** number of newest complete frame (0 = none, yet) */
+        uint64_t                        latest;
+} ShmRingHeader;
+
+
+/** header of every slot, pixels follow at the next SHMRING_ALIGN boundary */
+typedef struct
+{
+        /** 2n while frame n is complete, 2n - 1 while it's written */
+        uint64_t                        seq;
+} ShmRingSlot;
+
+
+/** opaque handle of a mapped ring */
+typedef struct _ShmRing         ShmRing;
+
+
+ShmRing                        *shmring_create(const char *name, LedFrameCord w, LedFrameCord h, const char *format, size_t bpp, bool big_endian, size_t slots);
+void                            shmring_publish(ShmRing * r, const uint8_t * src);
+ShmRing                        *shmring_open(const char *name);
+void                            shmring_close(ShmRing * r);
+const ShmRingHeader            *shmring_header(ShmRing * r);
+bool                            shmring_alive(ShmRing * r);
+NftResult                       shmring_read(ShmRing * r, uint8_t * dst, LedFrameCord x, LedFrameCord y, LedFrameCord w, LedFrameCord h, uint64_t * seq);
+
+
+
+#endif /** _SHMRING_H */
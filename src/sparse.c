@@ -0,0 +1,348 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * sparse capture: only capture the pixels that are actually sampled by the
+ * LEDs of all hardware chains. The sampled coordinates are grouped into a
+ * few rectangles once, after the chain mapping was initialized.
+ */
+
+#include <stdlib.h>
+#include <niftyled.h>
+#include "capture.h"
+#include "sparse.h"
+
+
+/** pixels between two sampled pixels that may be captured in between to
+    save another request */
+#define SPARSE_GAP 32
+
+
+#ifndef MIN
+#define MIN(a,b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a,b) (((a) > (b)) ? (a) : (b))
+#endif
+
+
+/** private structure to hold info accros function-calls */
+static struct
+{
+        /** rectangles to capture */
+        CaptureRect *rects;
+        /** amount of rectangles */
+        size_t n;
+} _c;
+
+
+
+/** sort rectangles by row, then column */
+static int _cmp_rows(const void *a, const void *b)
+{
+        const CaptureRect *ra = a, *rb = b;
+
+        if(ra->y != rb->y)
+                return ra->y - rb->y;
+
+        return ra->x - rb->x;
+}
+
+
+/** sort rectangles by span, then row */
+static int _cmp_spans(const void *a, const void *b)
+{
+        const CaptureRect *ra = a, *rb = b;
+
+        if(ra->x != rb->x)
+                return ra->x - rb->x;
+        if(ra->w != rb->w)
+                return ra->w - rb->w;
+
+        return ra->y - rb->y;
+}
+
+
+/** area of bounding box of a & b */
+static long _union_area(CaptureRect * a, CaptureRect * b)
+{
+        long w = MAX(a->x + a->w, b->x + b->w) - MIN(a->x, b->x);
+        long h = MAX(a->y + a->h, b->y + b->h) - MIN(a->y, b->y);
+
+        return w * h;
+}
+
+
+/** grow rectangle a to also cover rectangle b */
+static void _union(CaptureRect * a, CaptureRect * b)
+{
+        LedFrameCord x2 = MAX(a->x + a->w, b->x + b->w);
+        LedFrameCord y2 = MAX(a->y + a->h, b->y + b->h);
+
+        a->x = MIN(a->x, b->x);
+        a->y = MIN(a->y, b->y);
+        a->w = x2 - a->x;
+        a->h = y2 - a->y;
+}
+
+
+/** merge pixels of one row that are close to each other into spans */
+static size_t _merge_rows(CaptureRect * r, size_t n)
+{
+        qsort(r, n, sizeof(CaptureRect), _cmp_rows);
+
+        size_t i, m = 0;
+        for(i = 1; i < n; i++)
+        {
+                if(r[i].y == r[m].y && r[i].x <= r[m].x + r[m].w + SPARSE_GAP)
+                        _union(&r[m], &r[i]);
+                else
+                        r[++m] = r[i];
+        }
+
+        return n ? m + 1 : 0;
+}
+
+
+/** merge equal spans of rows that are close to each other */
+static size_t _merge_spans(CaptureRect * r, size_t n)
+{
+        qsort(r, n, sizeof(CaptureRect), _cmp_spans);
+
+        size_t i, m = 0;
+        for(i = 1; i < n; i++)
+        {
+                if(r[i].x == r[m].x && r[i].w == r[m].w &&
+                   r[i].y <= r[m].y + r[m].h + SPARSE_GAP)
+                        _union(&r[m], &r[i]);
+                else
+                        r[++m] = r[i];
+        }
+
+        return n ? m + 1 : 0;
+}
+
+
+/** merge all rectangles into their bounding box */
+static size_t _bounding_box(CaptureRect * r, size_t n)
+{
+        size_t i;
+        for(i = 1; i < n; i++)
+                _union(&r[0], &r[i]);
+
+        return n ? 1 : 0;
+}
+
+
+/** merge rectangles that waste least pixels until at most max are left */
+static size_t _merge_greedy(CaptureRect * r, size_t n, size_t max)
+{
+        while(n > max)
+        {
+                size_t i, j, a = 0, b = 1;
+                long best = -1;
+
+                for(i = 0; i < n; i++)
+                {
+                        for(j = i + 1; j < n; j++)
+                        {
+                                long waste = _union_area(&r[i], &r[j]) -
+                                        (long) r[i].w * r[i].h -
+                                        (long) r[j].w * r[j].h;
+                                if(best < 0 || waste < best)
+                                {
+                                        best = waste;
+                                        a = i;
+                                        b = j;
+                                }
+                        }
+                }
+
+                _union(&r[a], &r[b]);
+                r[b] = r[--n];
+        }
+
+        return n;
+}
+
+
+/**
+ * calculate rectangles that contain all pixels sampled by the LEDs of all
+ * hardware in the list. Must be called after led_chain_map_from_frame()
+ */
+NftResult sparse_init(LedHardware * hw, LedFrame * frame)
+{
+        if(!hw || !frame)
+                NFT_LOG_NULL(NFT_FAILURE);
+
+        sparse_deinit();
+
+        LedFrameCord w, h;
+        if(!led_frame_get_dim(frame, &w, &h))
+                return NFT_FAILURE;
+
+        /* count LEDs */
+        size_t count = 0;
+        LedHardware *t;
+        for(t = hw; t; t = led_hardware_list_get_next(t))
+                count += led_chain_get_ledcount(led_hardware_get_chain(t));
+
+        if(!(_c.rects = calloc(MAX(count, 1), sizeof(CaptureRect))))
+        {
+                NFT_LOG_PERROR("calloc()");
+                return NFT_FAILURE;
+        }
+
+        /* one pixel per LED */
+        for(t = hw; t; t = led_hardware_list_get_next(t))
+        {
+                LedChain *chain = led_hardware_get_chain(t);
+                LedCount i;
+                for(i = 0; i < led_chain_get_ledcount(chain); i++)
+                {
+                        Led *l = led_chain_get_nth(chain, i);
+                        LedFrameCord x = led_get_x(l);
+                        LedFrameCord y = led_get_y(l);
+
+                        /* LEDs outside of frame don't sample anything */
+                        if(x < 0 || y < 0 || x >= w || y >= h)
+                                continue;
+
+                        _c.rects[_c.n].x = x;
+                        _c.rects[_c.n].y = y;
+                        _c.rects[_c.n].w = 1;
+                        _c.rects[_c.n].h = 1;
+                        _c.n++;
+                }
+        }
+
+        _c.n = _merge_rows(_c.rects, _c.n);
+        _c.n = _merge_spans(_c.rects, _c.n);
+
+        /* greedy merging is O(n^3), give up on very scattered setups */
+        if(_c.n > SPARSE_RECTS_MAX * SPARSE_RECTS_MAX)
+                _c.n = _bounding_box(_c.rects, _c.n);
+        else
+                _c.n = _merge_greedy(_c.rects, _c.n, SPARSE_RECTS_MAX);
+
+        /* print result */
+        long pixels = 0, total = (long) w * h;
+        size_t i;
+        for(i = 0; i < _c.n; i++)
+        {
+                NFT_LOG(L_VERBOSE, "Sparse capture region %zu: %dx%d+%d+%d",
+                        i, _c.rects[i].w, _c.rects[i].h, _c.rects[i].x,
+                        _c.rects[i].y);
+                pixels += (long) _c.rects[i].w * _c.rects[i].h;
+        }
+
+        NFT_LOG(L_INFO,
+                "Sparse capture: %zu regions, %ld of %ld pixels (%ld%%)",
+                _c.n, pixels, total, total > 0 ? pixels * 100 / total : 0);
+
+        return NFT_SUCCESS;
+}
+
+
+/**
+ * free resources
+ */
+void sparse_deinit()
+{
+        free(_c.rects);
+        _c.rects = NULL;
+        _c.n = 0;
+}
+
+
+/**
+ * get rectangles calculated by sparse_init()
+ */
+CaptureRect *sparse_rects(size_t * n)
+{
+        if(!n)
+                NFT_LOG_NULL(NULL);
+
+        *n = _c.n;
+        return _c.rects;
+}
+
+
+/**
+ * intersect rectangles with sparse rectangles
+ *
+ * @param rects rectangles to intersect
+ * @param n amount of rectangles
+ * @param result space for max resulting rectangles
+ * @param max maximum amount of resulting rectangles
+ * @result amount of rectangles written to result
+ */
+size_t sparse_clip(CaptureRect * rects, size_t n, CaptureRect * result,
+                   size_t max)
+{
+        size_t i, j, m = 0;
+        for(i = 0; i < n; i++)
+        {
+                for(j = 0; j < _c.n && m < max; j++)
+                {
+                        CaptureRect *s = &_c.rects[j];
+                        LedFrameCord x1 = MAX(rects[i].x, s->x);
+                        LedFrameCord y1 = MAX(rects[i].y, s->y);
+                        LedFrameCord x2 = MIN(rects[i].x + rects[i].w,
+                                              s->x + s->w);
+                        LedFrameCord y2 = MIN(rects[i].y + rects[i].h,
+                                              s->y + s->h);
+
+                        if(x2 <= x1 || y2 <= y1)
+                                continue;
+
+                        result[m].x = x1;
+                        result[m].y = y1;
+                        result[m].w = x2 - x1;
+                        result[m].h = y2 - y1;
+                        m++;
+                }
+        }
+
+        return m;
+}
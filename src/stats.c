@@ -0,0 +1,255 @@
+/*
+ * ledmag - Display portion of screen on a LED-Setup using libniftyled
+ * Copyright (C) 2006-2014 Daniel Hiepler <daniel@niftylight.de>
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Alternatively, the contents of this file may be used under the
+ * GNU Lesser General Public License Version 2.1 (the "LGPL"), in
+ * which case the following provisions apply instead of the ones
+ * mentioned above:
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ * Boston, MA 02111-1307, USA.
+ */
+
+/**
+ * per-stage latency statistics of the main-loop
+ *
+ * Every stage records its durations into a histogram with logarithmic
+ * buckets (STATS_SUB buckets per power of two, so values are off by
+ * 1/STATS_SUB at most). Memory is fixed, recording a sample is a few
+ * arithmetic operations. Every stage is only recorded by one thread, totals
+ * may be read from any thread.
+ */
+
+#include <signal.h>
+#include <time.h>
+#include <niftyled.h>
+#include "stats.h"
+
+
+/** log2 of buckets per power of two */
+#define STATS_SUB_BITS 3
+/** buckets per power of two */
+#define STATS_SUB (1 << STATS_SUB_BITS)
+/** amount of buckets (covers 0 ns - 2^48 ns) */
+#define STATS_BUCKETS (48 * STATS_SUB)
+
+/** nanoseconds per second */
+#define NSEC 1000000000LL
+
+
+/** histogram of one stage */
+typedef struct
+{
+        unsigned long long count;
+        long long sum;
+        long long min;
+        long long max;
+        unsigned long long buckets[STATS_BUCKETS];
+} Histogram;
+
+
+/** private structure to hold info accros function-calls */
+static struct
+{
+        /** one histogram per stage */
+        Histogram stages[STAGE_MAX];
+        /** set by signal handler when statistics should be printed */
+        volatile sig_atomic_t dump;
+} _c;
+
+
+/** printable names of stages */
+static const char *_names[STAGE_MAX] = {
+        [STAGE_CAPTURE] = "capture",
+        [STAGE_FILL] = "fill",
+        [STAGE_SEND] = "send",
+        [STAGE_DELAY] = "delay",
+        [STAGE_SHOW] = "show",
+};
+
+
+
+/** bucket of value */
+static int _bucket(long long v)
+{
+        if(v < STATS_SUB)
+                return v < 0 ? 0 : v;
+
+        /* position of highest bit & the STATS_SUB_BITS bits below it */
+        int msb = 63 - __builtin_clzll(v);
+        int sub = (v >> (msb - STATS_SUB_BITS)) & (STATS_SUB - 1);
+        int b = (msb - STATS_SUB_BITS + 1) * STATS_SUB + sub;
+
+        return b < STATS_BUCKETS ? b : STATS_BUCKETS - 1;
+}
+
+
+/** smallest value of bucket */
+static long long _bucket_value(int b)
+{
+        if(b < STATS_SUB)
+                return b;
+
+        int msb = b / STATS_SUB + STATS_SUB_BITS - 1;
+        long long sub = b % STATS_SUB;
+
+        return (1LL << msb) | (sub << (msb - STATS_SUB_BITS));
+}
+
+
+/** value at percentile p (0-100) of histogram */
+static long long _percentile(Histogram * h, int p)
+{
+        unsigned long long rank = (h->count * p + 99) / 100, seen = 0;
+
+        int b;
+        for(b = 0; b < STATS_BUCKETS; b++)
+        {
+                seen += h->buckets[b];
+                if(seen >= rank && seen > 0)
+                {
+                        /* stay within what we actually measured */
+                        long long v = _bucket_value(b);
+                        if(v < h->min)
+                                return h->min;
+                        return v > h->max ? h->max : v;
+                }
+        }
+
+        return h->max;
+}
+
+
+/**
+ * current time in nanoseconds (CLOCK_MONOTONIC)
+ */
+long long stats_now()
+{
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * NSEC + ts.tv_nsec;
+}
+
+
+/**
+ * record duration of stage
+ *
+ * @param stage stage to record
+ * @param start time the stage started at (from stats_now())
+ */
+void stats_record(StatsStage stage, long long start)
+{
+        Histogram *h = &_c.stages[stage];
+        long long v = stats_now() - start;
+
+        if(h->count == 0 || v < h->min)
+                h->min = v;
+        if(v > h->max)
+                h->max = v;
+
+        h->buckets[_bucket(v)]++;
+        __atomic_store_n(&h->sum, h->sum + v, __ATOMIC_RELAXED);
+        __atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * get amount of recorded samples & their summed up duration of stage
+ *
+ * @param stage stage to query
+ * @param count space for amount of samples
+ * @param sum space for total duration in nanoseconds
+ */
+void stats_total(StatsStage stage, unsigned long long *count, long long *sum)
+{
+        *count = __atomic_load_n(&_c.stages[stage].count, __ATOMIC_RELAXED);
+        *sum = __atomic_load_n(&_c.stages[stage].sum, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * printable name of stage
+ */
+const char *stats_stage_name(StatsStage stage)
+{
+        return _names[stage];
+}
+
+
+/**
+ * ask for statistics to be printed (safe to call from signal handler)
+ */
+void stats_request_dump()
+{
+        _c.dump = 1;
+}
+
+
+/**
+ * print statistics if they were requested. Call regularly from main-loop
+ */
+void stats_poll()
+{
+        if(!_c.dump)
+                return;
+
+        _c.dump = 0;
+        stats_print(L_INFO);
+}
+
+
+/**
+ * print statistics of all stages
+ */
+void stats_print(NftLoglevel level)
+{
+        NFT_LOG(level, "%-8s %10s %9s %9s %9s %9s %9s %9s (ms)", "stage",
+                "frames", "min", "mean", "p50", "p90", "p99", "max");
+
+        int s;
+        for(s = 0; s < STAGE_MAX; s++)
+        {
+                Histogram *h = &_c.stages[s];
+
+                if(h->count == 0)
+                        continue;
+
+                NFT_LOG(level,
+                        "%-8s %10llu %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f",
+                        _names[s], h->count, h->min / 1e6,
+                        (double) h->sum / h->count / 1e6,
+                        _percentile(h, 50) / 1e6, _percentile(h, 90) / 1e6,
+                        _percentile(h, 99) / 1e6, h->max / 1e6);
+        }
+}